@@ -9,236 +9,381 @@
 
 #include "shared_Mem.h"
 #include "Resource_Allocation.h"
+#include "DeadlockDetection.h"
 #include "DeadlockResolution.h"
+#include "TrainCommunication.h"
+#include "SimConfig.h"
 #include <iostream>
 #include <stdexcept>
 #include <fstream>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
+#include <cstdint>
+#include <mutex>
+#include <algorithm>
 
 using namespace std;
 
-// Structure to represent a node in the resource allocation graph
-struct Node {
-    string id;  // either trainID ("Train0") or intersectionID ("IntersectionA")
-    bool isTrain;  // true if node represents a train, false if intersection
-    vector<string> edges;  // outgoing edges to other nodes
-};
+// search colours of DeadlockDetector::colour
+const uint8_t WHITE = 0;
+const uint8_t GREY = 1;
+const uint8_t BLACK = 2;
 
-class DeadlockDetector {
-private:
-    unordered_map<string, Node> graph;
-    unordered_set<string> visited;
-    unordered_set<string> recStack;
-
-public:
-    // Build the resource allocation graph from shared memory
-    void buildGraph(shared_mem_t *shm, const vector<Intersection> &intersections) {
-        graph.clear();
-        
-        // Access the held matrix
-        int *held = reinterpret_cast<int *>(
-            reinterpret_cast<char *>(shm) + sizeof(shared_mem_t) +
-            shm->num_sem * sizeof(int) +
-            shm->num_mutex * sizeof(pthread_mutex_t) +
-            shm->num_sem * sizeof(sem_t));
-        
-        // Access the waiting matrix
-        int *waiting = held + (shm->num_trains * shm->num_intersections);
-        
-        // Create nodes for all trains and intersections
-        for (int t = 0; t < shm->num_trains; t++) {
-            string trainID = "Train" + to_string(t);
-            Node trainNode;
-            trainNode.id = trainID;
-            trainNode.isTrain = true;
-            graph[trainID] = trainNode;
-        }
-        
-        for (int i = 0; i < shm->num_intersections; i++) {
-            string intersectionID = intersections[i].name;
-            Node intersectionNode;
-            intersectionNode.id = intersectionID;
-            intersectionNode.isTrain = false;
-            graph[intersectionID] = intersectionNode;
-        }
-        
-        // Add edges for held resources (Train -> Intersection)
-        for (int t = 0; t < shm->num_trains; t++) {
-            string trainID = "Train" + to_string(t);
-            
-            for (int i = 0; i < shm->num_intersections; i++) {
-                if (held[t * shm->num_intersections + i] == 1) {
-                    string intersectionID = intersections[i].name;
-                    graph[trainID].edges.push_back(intersectionID);
-                }
+// Function to find the held matrix in shared memory, the waiting matrix follows it
+static int *heldMatrix(shared_mem_t *shm) {
+    return reinterpret_cast<int *>(
+        reinterpret_cast<char *>(shm) + sizeof(shared_mem_t) +
+        shm->num_sem * sizeof(int) +
+        shm->num_mutex * sizeof(pthread_mutex_t) +
+        shm->num_sem * sizeof(sem_t) +
+        shm->num_intersections * sizeof(Intersection));
+}
+
+// Build the resource allocation graph from shared memory
+void DeadlockDetector::buildGraph(shared_mem_t *shm) {
+    int *held = heldMatrix(shm);
+    int *waiting = held + (shm->num_trains * shm->num_intersections);
+    buildGraph(shm->num_trains, shm->num_intersections, held, waiting);
+}
+
+/*
+    Build the graph from the held and waiting matrices (row = train, column = intersection) in
+    one pass over them. Train edges come out row by row, already in CSR order; wait edges are
+    grouped by intersection afterwards with a counting sort. The arrays are reused, so they are
+    only reallocated when the scenario grows.
+*/
+void DeadlockDetector::buildGraph(int trains, int intersections, const int *held, const int *waiting) {
+    numTrains = trains;
+    numIntersections = intersections;
+    int numNodes = trains + intersections;
+
+    // Train -> Intersection for held resources, counting Intersection -> Train edges on the way
+    firstEdge.assign(numNodes + 1, 0);
+    edgeTarget.clear();
+    stack.clear();      // wait edges as (train, intersection) pairs until they are placed
+    for (int t = 0; t < trains; t++) {
+        firstEdge[t] = edgeTarget.size();
+        const int *heldRow = held + t * intersections;
+        const int *waitingRow = waiting + t * intersections;
+        for (int i = 0; i < intersections; i++) {
+            if (heldRow[i] == 1) {
+                edgeTarget.push_back(trains + i);
             }
-        }
-        
-        // Add edges for waiting resources (Intersection -> Train)
-        for (int t = 0; t < shm->num_trains; t++) {
-            string trainID = "Train" + to_string(t);
-            
-            for (int i = 0; i < shm->num_intersections; i++) {
-                if (waiting[t * shm->num_intersections + i] == 1) {
-                    string intersectionID = intersections[i].name;
-                    graph[intersectionID].edges.push_back(trainID);
-                }
+            if (waitingRow[i] == 1) {
+                stack.push_back(t);
+                stack.push_back(i);
+                firstEdge[trains + i + 1]++;
             }
         }
     }
-    
-    // Detect cycles in the graph using DFS
-    bool isCyclic(string nodeID, vector<string> &cycle) {
-        if (recStack.find(nodeID) != recStack.end()) {
-            // Found a cycle, complete it
-            cycle.push_back(nodeID);
-            return true;
-        }
-        
-        if (visited.find(nodeID) != visited.end()) {
-            return false;
+
+    // Intersection -> Train for waiting resources, placed after the train edges
+    firstEdge[trains] = edgeTarget.size();
+    for (int n = trains; n < numNodes; n++) {
+        firstEdge[n + 1] += firstEdge[n];
+    }
+    edgeTarget.resize(firstEdge[numNodes]);
+    nextEdge.assign(firstEdge.begin() + trains, firstEdge.end() - 1);
+    for (size_t w = 0; w < stack.size(); w += 2) {
+        edgeTarget[nextEdge[stack[w + 1]]++] = stack[w];
+    }
+}
+
+/*
+    Depth-first search from every train with an explicit stack. A GREY node is on the current
+    path, so reaching one again closes a cycle: the stack from that node to the top. Every edge
+    is followed once, and a long chain of waiting trains cannot overflow the call stack.
+*/
+bool DeadlockDetector::detectDeadlock(DeadlockCycle &cycle) {
+    cycle.trains.clear();
+    cycle.intersections.clear();
+    int numNodes = numTrains + numIntersections;
+    colour.assign(numNodes, WHITE);
+    nextEdge.resize(numNodes);
+
+    // every cycle goes through a train, so starting from the trains finds all of them
+    for (int start = 0; start < numTrains; start++) {
+        if (colour[start] != WHITE) {
+            continue;
         }
-        
-        visited.insert(nodeID);
-        recStack.insert(nodeID);
-        cycle.push_back(nodeID);
-        
-        for (const string &neighbor : graph[nodeID].edges) {
-            if (isCyclic(neighbor, cycle)) {
-                return true;
+        stack.clear();
+        stack.push_back(start);
+        colour[start] = GREY;
+        nextEdge[start] = firstEdge[start];
+
+        while (!stack.empty()) {
+            int node = stack.back();
+            if (nextEdge[node] == firstEdge[node + 1]) {
+                colour[node] = BLACK;
+                stack.pop_back();
+                continue;
             }
-        }
-        
-        // Remove from recursion stack and cycle
-        recStack.erase(nodeID);
-        cycle.pop_back();
-        return false;
-    }
-    
-    // Find a cycle in the resource allocation graph
-    bool detectDeadlock(vector<string> &deadlockCycle) {
-        visited.clear();
-        recStack.clear();
-        
-        // Check for cycles starting from each train
-        for (const auto &pair : graph) {
-            if (pair.second.isTrain && visited.find(pair.first) == visited.end()) {
-                vector<string> cycle;
-                if (isCyclic(pair.first, cycle)) {
-                    // Find the start of the cycle
-                    string startNode = cycle.back();
-                    
-                    // Extract the actual cycle
-                    bool foundStart = false;
-                    for (const string &node : cycle) {
-                        if (node == startNode) {
-                            foundStart = true;
-                        }
-                        
-                        if (foundStart) {
-                            deadlockCycle.push_back(node);
-                        }
+            int next = edgeTarget[nextEdge[node]++];
+            if (colour[next] == WHITE) {
+                colour[next] = GREY;
+                nextEdge[next] = firstEdge[next];
+                stack.push_back(next);
+            }
+            else if (colour[next] == GREY) {
+                // the cycle is the stack from next up, trains and intersections alternate;
+                // start it at a train so trains[k] holds intersections[k]
+                size_t first = stack.size() - 1;
+                while (stack[first] != next) {
+                    first--;
+                }
+                size_t length = stack.size() - first;
+                size_t offset = next < numTrains ? 0 : 1;
+                for (size_t k = 0; k < length; k++) {
+                    int member = stack[first + (k + offset) % length];
+                    if (member < numTrains) {
+                        cycle.trains.push_back(member);
+                    } else {
+                        cycle.intersections.push_back(member - numTrains);
                     }
-                    
-                    return true;
                 }
+                return true;
             }
         }
-        
-        return false;
     }
-    
-    // Debug function to print the graph if needed
-    void printGraph() {
-        cout << "Resource Allocation Graph:" << endl;
-        for (const auto &pair : graph) {
-            const Node &node = pair.second;
-            cout << node.id << " (" << (node.isTrain ? "Train" : "Intersection") << ") -> ";
-            
-            if (node.edges.empty()) {
-                cout << "None";
-            } else {
-                for (size_t i = 0; i < node.edges.size(); i++) {
-                    cout << node.edges[i];
-                    if (i < node.edges.size() - 1) {
-                        cout << ", ";
-                    }
-                }
+    return false;
+}
+
+// Debug function to print the graph if needed
+void DeadlockDetector::printGraph(const vector<Intersection> &intersections) {
+    cout << "Resource Allocation Graph:" << endl;
+    for (int n = 0; n < numTrains + numIntersections; n++) {
+        bool isTrain = n < numTrains;
+        cout << (isTrain ? trainNames[n] : string(intersections[n - numTrains].name))
+             << " (" << (isTrain ? "Train" : "Intersection") << ") -> ";
+
+        if (firstEdge[n] == firstEdge[n + 1]) {
+            cout << "None";
+        }
+        for (int e = firstEdge[n]; e < firstEdge[n + 1]; e++) {
+            int target = edgeTarget[e];
+            cout << (target < numTrains ? trainNames[target] : string(intersections[target - numTrains].name));
+            if (e < firstEdge[n + 1] - 1) {
+                cout << ", ";
             }
-            cout << endl;
         }
+        cout << endl;
     }
-};
+}
 
-// Format a cycle into a readable string
-string formatCycle(const vector<string> &cycle) {
+// Format a cycle into a readable string, back to the train it started from
+string formatCycle(const DeadlockCycle &cycle, const Intersection *inter_ptr) {
     string result = "";
-    for (size_t i = 0; i < cycle.size(); i++) {
-        result += cycle[i];
-        if (i < cycle.size() - 1) {
-            result += " → ";
-        }
+    for (size_t k = 0; k < cycle.trains.size(); k++) {
+        result += trainNames[cycle.trains[k]] + " → " + inter_ptr[cycle.intersections[k]].name + " → ";
+    }
+    if (!cycle.trains.empty()) {
+        result += trainNames[cycle.trains[0]];
     }
     return result;
 }
 
 // Function to check for deadlocks in the railway system
-bool checkForDeadlock(shared_mem_t *shm, const vector<Intersection> &intersections, string &cycleDesc) {
-    DeadlockDetector detector;
-    
+bool checkForDeadlock(shared_mem_t *shm, DeadlockCycle &cycle) {
+    // one detector per thread, its arrays are reused from check to check
+    static thread_local DeadlockDetector detector;
+
     // Build the resource allocation graph
-    detector.buildGraph(shm, intersections);
-    
+    detector.buildGraph(shm);
+
     // For debugging
-    // detector.printGraph();
-    
+    // detector.printGraph(intersections);
+
     // Detect deadlock
-    vector<string> deadlockCycle;
-    bool hasDeadlock = detector.detectDeadlock(deadlockCycle);
-    
-    if (hasDeadlock) {
-        cycleDesc = formatCycle(deadlockCycle);
-        return true;
+    return detector.detectDeadlock(cycle);
+}
+
+// Wait-for graph behind findWaitCycle, one per server process
+struct WaitGraph {
+    std::mutex lock;                        // worker threads update and search it concurrently
+    vector<vector<int>> holders;            // trains holding each intersection
+    vector<vector<int>> waitsFor;           // intersections each train waits for
+    vector<unsigned> seenIntersection;      // search stamps, equal to stamp once visited
+    vector<unsigned> seenTrain;
+    unsigned stamp = 0;
+    vector<int> reachedBy;                  // intersection: train whose wait edge led to it, -1 for the first
+    vector<int> heldVia;                    // train: the intersection it holds that led to it
+    vector<int> stack;
+    vector<int> neighbours;
+};
+
+static WaitGraph waitGraph;
+
+// Function to take value out of an edge list, order does not matter
+static void removeEdge(vector<int> &edges, int value) {
+    auto found = find(edges.begin(), edges.end(), value);
+    if (found != edges.end()) {
+        *found = edges.back();
+        edges.pop_back();
     }
-    
-    return false;
 }
 
-// Helper function to resolve deadlocks by selecting a train to preempt
-string selectTrainToPreempt(const vector<string> &deadlockCycle) {
-    // Simple strategy: select the first train in the cycle
-    for (const string &node : deadlockCycle) {
-        if (node.substr(0, 5) == "Train") {
-            return node;
-        }
+// Function to check the indices against the size of the graph
+static bool inWaitGraph(int trainIdx, int intersectionIdx) {
+    return trainIdx >= 0 && trainIdx < (int)waitGraph.waitsFor.size() &&
+           intersectionIdx >= 0 && intersectionIdx < (int)waitGraph.holders.size();
+}
+
+// Empty the graph for a new run, called where the held and waiting matrices are cleared
+void waitGraphReset(int numTrains, int numIntersections) {
+    lock_guard<std::mutex> guard(waitGraph.lock);
+    waitGraph.holders.assign(numIntersections, vector<int>());
+    waitGraph.waitsFor.assign(numTrains, vector<int>());
+    waitGraph.seenIntersection.assign(numIntersections, 0);
+    waitGraph.seenTrain.assign(numTrains, 0);
+    waitGraph.stamp = 0;
+    waitGraph.reachedBy.assign(numIntersections, -1);
+    waitGraph.heldVia.assign(numTrains, -1);
+}
+
+// trainIdx now holds intersectionIdx and no longer waits for it
+void waitGraphHold(int trainIdx, int intersectionIdx) {
+    lock_guard<std::mutex> guard(waitGraph.lock);
+    if (!inWaitGraph(trainIdx, intersectionIdx)) {
+        return;
+    }
+    vector<int> &holders = waitGraph.holders[intersectionIdx];
+    if (find(holders.begin(), holders.end(), trainIdx) == holders.end()) {
+        holders.push_back(trainIdx);
     }
-    return "";
+    removeEdge(waitGraph.waitsFor[trainIdx], intersectionIdx);
 }
 
-// Function to find an intersection that a train holds
-string getIntersectionHeldByTrain(shared_mem_t *shm, const vector<Intersection> &intersections, 
-                                 const string &trainID) {
-    // Extract train number
-    int trainNum = stoi(trainID.substr(5));
-    
-    // Access the held matrix
-    int *held = reinterpret_cast<int *>(
-        reinterpret_cast<char *>(shm) + sizeof(shared_mem_t) +
-        shm->num_sem * sizeof(int) +
-        shm->num_mutex * sizeof(pthread_mutex_t) +
-        shm->num_sem * sizeof(sem_t));
-    
-    // Find an intersection held by this train
-    for (int i = 0; i < shm->num_intersections; i++) {
-        if (held[trainNum * shm->num_intersections + i] == 1) {
-            return intersections[i].name;
+// trainIdx released intersectionIdx
+void waitGraphRelease(int trainIdx, int intersectionIdx) {
+    lock_guard<std::mutex> guard(waitGraph.lock);
+    if (inWaitGraph(trainIdx, intersectionIdx)) {
+        removeEdge(waitGraph.holders[intersectionIdx], trainIdx);
+    }
+}
+
+// trainIdx started waiting for intersectionIdx
+void waitGraphWait(int trainIdx, int intersectionIdx) {
+    lock_guard<std::mutex> guard(waitGraph.lock);
+    if (inWaitGraph(trainIdx, intersectionIdx)) {
+        waitGraph.waitsFor[trainIdx].push_back(intersectionIdx);
+    }
+}
+
+// trainIdx stopped waiting for intersectionIdx without getting it (it left)
+void waitGraphStopWaiting(int trainIdx, int intersectionIdx) {
+    lock_guard<std::mutex> guard(waitGraph.lock);
+    if (inWaitGraph(trainIdx, intersectionIdx)) {
+        removeEdge(waitGraph.waitsFor[trainIdx], intersectionIdx);
+    }
+}
+
+/*
+    Find the cycle trainIdx waiting on intersectionIdx closes. Any new cycle has to pass through
+    the new wait edge, so it is enough to follow the holders of the intersection and the
+    intersections those trains wait on, and see if the search comes back to trainIdx. The edge
+    lists of the wait graph make that cost proportional to the part of the graph behind the
+    edge. Shard servers only see their own intersections in their graph, so they follow the
+    edges in the shared held and waiting matrices instead, holding shm->wait_mutex so no other
+    shard adds a wait edge between the check and its own.
+*/
+bool findWaitCycle(shared_mem_t *shm, int *held, int *waiting, int trainIdx, int intersectionIdx, DeadlockCycle &cycle) {
+    int numTrains = shm->num_trains;
+    int numIntersections = shm->num_intersections;
+    bool shared = simConfig.shards > 1;
+    WaitGraph &graph = waitGraph;
+    lock_guard<std::mutex> guard(graph.lock);
+    if (!inWaitGraph(trainIdx, intersectionIdx)) {
+        return false;
+    }
+
+    // new stamp instead of clearing the seen arrays
+    if (++graph.stamp == 0) {
+        fill(graph.seenIntersection.begin(), graph.seenIntersection.end(), 0);
+        fill(graph.seenTrain.begin(), graph.seenTrain.end(), 0);
+        graph.stamp = 1;
+    }
+    graph.stack.clear();
+    graph.stack.push_back(intersectionIdx);
+    graph.seenIntersection[intersectionIdx] = graph.stamp;
+    graph.reachedBy[intersectionIdx] = -1;
+
+    while (!graph.stack.empty()) {
+        int i = graph.stack.back();
+        graph.stack.pop_back();
+
+        // Intersection -> Train edges (held)
+        const vector<int> *holders = &graph.holders[i];
+        if (shared) {
+            graph.neighbours.clear();
+            for (int t = 0; t < numTrains; t++) {
+                if (held[t * numIntersections + i] == 1) {
+                    graph.neighbours.push_back(t);
+                }
+            }
+            holders = &graph.neighbours;
+        }
+        for (int t : *holders) {
+            if (t == trainIdx) {
+                // trainIdx holds i: walk back to intersectionIdx, trainIdx waits for it
+                cycle.trains.assign(1, trainIdx);
+                cycle.intersections.assign(1, i);
+                for (int j = i; graph.reachedBy[j] != -1;) {
+                    int waiter = graph.reachedBy[j];
+                    j = graph.heldVia[waiter];
+                    cycle.trains.push_back(waiter);
+                    cycle.intersections.push_back(j);
+                }
+                return true;
+            }
+            if (graph.seenTrain[t] == graph.stamp) {
+                continue;
+            }
+            graph.seenTrain[t] = graph.stamp;
+            graph.heldVia[t] = i;
+
+            // Train -> Intersection edges (waiting)
+            if (shared) {
+                for (int j = 0; j < numIntersections; j++) {
+                    if (waiting[t * numIntersections + j] == 1 && graph.seenIntersection[j] != graph.stamp) {
+                        graph.seenIntersection[j] = graph.stamp;
+                        graph.reachedBy[j] = t;
+                        graph.stack.push_back(j);
+                    }
+                }
+                continue;
+            }
+            for (int j : graph.waitsFor[t]) {
+                if (graph.seenIntersection[j] != graph.stamp) {
+                    graph.seenIntersection[j] = graph.stamp;
+                    graph.reachedBy[j] = t;
+                    graph.stack.push_back(j);
+                }
+            }
         }
     }
-    
-    return "";
+    return false;
+}
+
+// Check if letting trainIdx wait on intersectionIdx would close a cycle
+bool waitWouldDeadlock(shared_mem_t *shm, int *held, int *waiting, int trainIdx, int intersectionIdx) {
+    DeadlockCycle cycle;
+    return findWaitCycle(shm, held, waiting, trainIdx, intersectionIdx, cycle);
+}
+
+/*
+    Preempt the first train of the cycle: it gives up the intersection of the cycle it holds,
+    which the next train in the cycle is waiting for.
+*/
+void breakDeadlock(shared_mem_t *shm, const Intersection *inter_ptr, const DeadlockCycle &cycle) {
+    if (cycle.trains.empty()) {
+        return;
+    }
+    const char *trainToPreempt = trainNames[cycle.trains[0]].c_str();
+    const char *intersectionToRelease = inter_ptr[cycle.intersections[0]].name;
+    cout << "Preempting " << intersectionToRelease << " from " << trainToPreempt << "." << endl;
+
+    // calls to resolveDeadlock in DeadlockResolution.cpp to forcibly release a held intersection
+    resolveDeadlock(shm, trainToPreempt, intersectionToRelease);
 }
 
 // Function to detect and handle deadlocks
@@ -247,43 +392,11 @@ string getIntersectionHeldByTrain(shared_mem_t *shm, const vector<Intersection>
     call this function from main with the shared mem pointer and vector<Intersection> to create graph and run deadlock detection
 */
 void detectAndResolveDeadlock(shared_mem_t *shm, const vector<Intersection> &intersections) {
-    string cycleDescription;
-    
-    if (checkForDeadlock(shm, intersections, cycleDescription)) {
-        cout << "Deadlock detected! Cycle: " << cycleDescription << endl;
-
-        /*
-        Future Use: Week 4 Task
-        */
-        // Parse the deadlock cycle into a vector
-        vector<string> cycle;
-        size_t pos = 0;
-        string token;
-        string delimiter = " → ";
-        string cycleString = cycleDescription;
-        
-        while ((pos = cycleString.find(delimiter)) != string::npos) {
-            token = cycleString.substr(0, pos);
-            cycle.push_back(token);
-            cycleString.erase(0, pos + delimiter.length());
-        }
-        cycle.push_back(cycleString); // Add the last part
-        
-        // Select a train to preempt
-        string trainToPreempt = selectTrainToPreempt(cycle);
-        
-        if (!trainToPreempt.empty()) {
-            // Find an intersection held by this train
-            string intersectionToRelease = getIntersectionHeldByTrain(shm, intersections, trainToPreempt);
-            
-            if (!intersectionToRelease.empty()) {
-                cout << "Preempting " << intersectionToRelease << " from " << trainToPreempt << "." << endl;
-                
-                // calls to resolveDeadlock in DeadlockResolution.cpp to forcibly release a held intersection
-                resolveDeadlock(shm, intersections, trainToPreempt.c_str(), intersectionToRelease.c_str());
-            }
-        }
+    DeadlockCycle cycle;
 
+    if (checkForDeadlock(shm, cycle)) {
+        cout << "Deadlock detected! Cycle: " << formatCycle(cycle, intersections.data()) << endl;
+        breakDeadlock(shm, intersections.data(), cycle);
     } else {
         cout << "No deadlock detected." << endl;
     }
@@ -12,45 +12,65 @@
 
 #include "shared_Mem.h"
 #include "Resource_Allocation.h"
+#include <cstdint>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
-
-// Structure to represent a node in the resource allocation graph
-struct Node {
-    std::string id;  // either trainID ("Train0") or intersectionID ("IntersectionA")
-    bool isTrain;    // true if node represents a train, false if intersection
-    std::vector<std::string> edges;  // outgoing edges to other nodes
+
+// A cycle in the resource allocation graph: trains[k] holds intersections[k], which
+// trains[k + 1] waits for, and the first train waits for the intersection the last one holds
+struct DeadlockCycle {
+    std::vector<int> trains;         // train indices (rows of the held/waiting matrices)
+    std::vector<int> intersections;  // intersection indices (columns)
 };
 
-// Class to handle deadlock detection using a resource allocation graph
+// Resource allocation graph on integer node IDs: trains are [0, T), intersections [T, T + I).
+// Edges (Train -> Intersection it holds, Intersection -> Train waiting for it) are kept in
+// compressed sparse row form, so a rebuild reuses the arrays and the search is an explicit stack.
 class DeadlockDetector {
 private:
-    std::unordered_map<std::string, Node> graph;
-    std::unordered_set<std::string> visited;
-    std::unordered_set<std::string> recStack;
+    int numTrains = 0;
+    int numIntersections = 0;
+    std::vector<int> firstEdge;    // edges of node n are edgeTarget[firstEdge[n] .. firstEdge[n + 1])
+    std::vector<int> edgeTarget;
+    std::vector<uint8_t> colour;   // WHITE not visited, GREY on the search stack, BLACK done
+    std::vector<int> nextEdge;     // next edge to follow for a GREY node
+    std::vector<int> stack;
 
 public:
-    // Build the resource allocation graph from shared memory
-    void buildGraph(shared_mem_t *shm, const std::vector<Intersection> &intersections);
-    
-    // Detect cycles in the graph using DFS (returns true if cycle found)
-    bool isCyclic(std::string nodeID, std::vector<std::string> &cycle);
-    
-    // Find a cycle in the resource allocation graph
-    bool detectDeadlock(std::vector<std::string> &deadlockCycle);
-    
+    // Build the resource allocation graph from the held and waiting matrices in shared memory
+    void buildGraph(shared_mem_t *shm);
+    void buildGraph(int trains, int intersections, const int *held, const int *waiting);
+
+    // Find a cycle in the resource allocation graph (returns true if one was found)
+    bool detectDeadlock(DeadlockCycle &cycle);
+
     // Debug function to print the graph
-    void printGraph();
+    void printGraph(const std::vector<Intersection> &intersections);
 };
 
-// Format a cycle into a readable string
-std::string formatCycle(const std::vector<std::string> &cycle);
+// Format a cycle into a readable string ("Train1 → IntersectionA → Train2 → ... → Train1")
+std::string formatCycle(const DeadlockCycle &cycle, const Intersection *inter_ptr);
 
 // Function to check for deadlocks in the railway system
-bool checkForDeadlock(shared_mem_t *shm, const std::vector<Intersection> &intersections, 
-                     std::string &cycleDesc);
+bool checkForDeadlock(shared_mem_t *shm, DeadlockCycle &cycle);
+
+// Preempt an intersection of the cycle so the trains can move again
+void breakDeadlock(shared_mem_t *shm, const Intersection *inter_ptr, const DeadlockCycle &cycle);
+
+// Wait-for graph kept next to the held and waiting matrices by lockIntersection, releaseIntersection
+// and addtoWaitMatrix (holders of every intersection, intersections every train waits for), so a
+// cycle search only visits the trains and intersections behind a new wait edge
+void waitGraphReset(int numTrains, int numIntersections);
+void waitGraphHold(int trainIdx, int intersectionIdx);
+void waitGraphRelease(int trainIdx, int intersectionIdx);
+void waitGraphWait(int trainIdx, int intersectionIdx);
+void waitGraphStopWaiting(int trainIdx, int intersectionIdx);
+
+// Find the cycle that trainIdx waiting on intersectionIdx closes in the resource allocation graph
+bool findWaitCycle(shared_mem_t *shm, int *held, int *waiting, int trainIdx, int intersectionIdx, DeadlockCycle &cycle);
+
+// Check if trainIdx waiting on intersectionIdx would close a cycle in the resource allocation graph
+bool waitWouldDeadlock(shared_mem_t *shm, int *held, int *waiting, int trainIdx, int intersectionIdx);
 
 // Main function to detect deadlocks, call in main
 void detectAndResolveDeadlock(shared_mem_t *shm, const std::vector<Intersection> &intersections);
@@ -18,19 +18,17 @@
 using namespace std;
 
 /*
-*   function: resolvedDeadlock is called from detectAndResolveDeadlock
+*   function: resolvedDeadlock is called from breakDeadlock
 *             it is used when a deadlock is detected to forcibly release a held intersection when from a train
 *
 *   input: shared_mem_t shm points to a shared memory block that stores held intersections from a train that is selected
 *          
-*          intersections is a vector of all intersections parsed into the system; it is used to map names for releasing 
-*          
 *          trainToPrempt is the ID of a train that is selected to break the deadlock
 *          
 *          intersectionToRelease is the name of the intersection that is being held by a train that will be released forcibly
 *
 */
-void resolveDeadlock(shared_mem_t* shm, const vector<Intersection>& intersections, const char* trainToPreempt, const char* intersectionToRelease) {
+void resolveDeadlock(shared_mem_t* shm, const char* trainToPreempt, const char* intersectionToRelease) {
     
     // accesses the shared memory layout
     char* base = reinterpret_cast<char*>(shm) + sizeof(shared_mem_t);
@@ -44,10 +42,18 @@ void resolveDeadlock(shared_mem_t* shm, const vector<Intersection>& intersection
     cout << "The server detected a deadlock involving " << trainToPreempt << " holding " << intersectionToRelease << ".\n";
     cout << "Forcibly releasing " << intersectionToRelease << " from " << trainToPreempt << ".\n";
 
+    // look up the indices used by the held matrix
+    int trainIdx = findTrainIndex(trainToPreempt);
+    Intersection* intersection = findIntersectionbyID(intersectionToRelease, inter_ptr, shm->num_intersections);
+    if (trainIdx < 0 || intersection == nullptr) {
+        cerr << "resolveDeadlock [ERROR]: unknown train or intersection " << trainToPreempt << " " << intersectionToRelease << endl;
+        return;
+    }
+
     // performs the release
-    releaseIntersection(shm, inter_ptr, sem, mutex, intersectionToRelease, trainToPreempt, held);
+    releaseIntersection(shm, inter_ptr, sem, mutex, intersection->index, trainIdx, held);
 
     // confirms in console and logs the release in simulation.log
     cout << "Cycle is broken. Trains may proceed.\n";
-    logMessage(string(trainToPreempt) + " released " + intersectionToRelease + " forcibly to resolve deadlock.");
+    logEvent(EventType::DEADLOCK_PREEMPTED, trainIdx, intersection->index);
 }
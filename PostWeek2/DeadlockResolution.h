@@ -14,6 +14,6 @@
 #include <string>
 
 // calls when a deadlock is detected to forcibly release a held intersection
-void resolveDeadlock(shared_mem_t* shm, const std::vector<Intersection>& intersections, const char* trainToPreempt, const char* intersectionToRelease);
+void resolveDeadlock(shared_mem_t* shm, const char* trainToPreempt, const char* intersectionToRelease);
 
 #endif // DEADLOCKRESOLUTION_H
@@ -0,0 +1,291 @@
+/*  Group G
+    Date: 4/29/2025
+    Program Description: Greedy graph growing plus boundary refinement for the
+    intersection co-usage graph.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include "Partitioner.h"
+#include "sync.h"
+#include "SimConfig.h"
+
+// part of every intersection, empty until setupPartition
+static std::vector<int> intersectionPart;
+
+// most refinement passes over all intersections
+static const int REFINE_PASSES = 10;
+
+int partitionOf(int intersectionIdx)
+{
+    int parts = std::max(simConfig.shards, simConfig.threads);
+    if (intersectionPart.empty())
+    {
+        return intersectionIdx % parts;
+    }
+    return intersectionPart[intersectionIdx];
+}
+
+/* buildGraph counts consecutive hop pairs (both directions) and visits per intersection */
+static void buildGraph(const std::vector<std::vector<int>>& routes, int num_intersections,
+    std::vector<std::vector<long>>& weight, std::vector<long>& visits)
+{
+    weight.assign(num_intersections, std::vector<long>(num_intersections, 0));
+    visits.assign(num_intersections, 0);
+    for (const std::vector<int>& route : routes)
+    {
+        for (size_t hop = 0; hop < route.size(); hop++)
+        {
+            visits[route[hop]]++;
+            if (hop + 1 < route.size() && route[hop] != route[hop + 1])
+            {
+                weight[route[hop]][route[hop + 1]]++;
+                weight[route[hop + 1]][route[hop]]++;
+            }
+        }
+    }
+}
+
+/*
+* partitionIntersections grows the parts greedily, busiest intersection first: each one joins
+* the part it shares the most hops with, as long as that part stays under its share of the
+* visits (ties go to the lightest part). Refinement then moves single intersections to
+* another part while that removes cut hops and keeps the balance.
+*/
+std::vector<int> partitionIntersections(const std::vector<std::vector<int>>& routes, int num_intersections, int parts)
+{
+    std::vector<std::vector<long>> weight;
+    std::vector<long> visits;
+    buildGraph(routes, num_intersections, weight, visits);
+
+    // intersections nobody visits still count a little so they spread out
+    long total = 0;
+    for (long& v : visits)
+    {
+        v = std::max(v, 1L);
+        total += v;
+    }
+    long limit = (total + parts - 1) / parts;
+    long heaviest = *std::max_element(visits.begin(), visits.end());
+    limit = std::max(limit + limit / 10, heaviest);   // 10% slack, and room for the busiest one
+
+    std::vector<int> order(num_intersections);
+    for (int i = 0; i < num_intersections; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&visits](int a, int b) { return visits[a] > visits[b]; });
+
+    std::vector<int> part(num_intersections, -1);
+    std::vector<long> load(parts, 0);
+    for (int node : order)
+    {
+        int best = -1;
+        long bestLink = -1;
+        for (int p = 0; p < parts; p++)
+        {
+            if (load[p] + visits[node] > limit)
+            {
+                continue;
+            }
+            long link = 0;
+            for (int other = 0; other < num_intersections; other++)
+            {
+                if (part[other] == p)
+                {
+                    link += weight[node][other];
+                }
+            }
+            if (link > bestLink || (link == bestLink && load[p] < load[best]))
+            {
+                best = p;
+                bestLink = link;
+            }
+        }
+        if (best == -1)
+        {
+            // nothing has room left, use the lightest part
+            best = std::min_element(load.begin(), load.end()) - load.begin();
+        }
+        part[node] = best;
+        load[best] += visits[node];
+    }
+
+    // refinement: move an intersection to the part it is most connected to if that cuts fewer hops
+    for (int pass = 0; pass < REFINE_PASSES; pass++)
+    {
+        bool moved = false;
+        for (int node : order)
+        {
+            std::vector<long> link(parts, 0);
+            for (int other = 0; other < num_intersections; other++)
+            {
+                if (other != node)
+                {
+                    link[part[other]] += weight[node][other];
+                }
+            }
+            int from = part[node];
+            int to = from;
+            for (int p = 0; p < parts; p++)
+            {
+                if (link[p] > link[to] && load[p] + visits[node] <= limit)
+                {
+                    to = p;
+                }
+            }
+            if (to != from)
+            {
+                part[node] = to;
+                load[from] -= visits[node];
+                load[to] += visits[node];
+                moved = true;
+            }
+        }
+        if (!moved)
+        {
+            break;
+        }
+    }
+    return part;
+}
+
+PartitionSummary summarizePartition(const std::vector<std::vector<int>>& routes, const std::vector<int>& assignment, int parts)
+{
+    PartitionSummary summary;
+    summary.loads.assign(parts, 0);
+    for (const std::vector<int>& route : routes)
+    {
+        for (size_t hop = 0; hop < route.size(); hop++)
+        {
+            summary.loads[assignment[route[hop]]]++;
+            if (hop + 1 < route.size())
+            {
+                summary.totalHops++;
+                if (assignment[route[hop]] != assignment[route[hop + 1]])
+                {
+                    summary.cutHops++;
+                }
+            }
+        }
+    }
+    return summary;
+}
+
+/* savePartition writes one "IntersectionName part" line per intersection */
+bool savePartition(const char *path, const Intersection *inter_ptr, const std::vector<int>& assignment)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "savePartition [ERROR]: Failed to open " << path << " for writing." << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < assignment.size(); i++)
+    {
+        file << inter_ptr[i].name << " " << assignment[i] << "\n";
+    }
+    return true;
+}
+
+/* loadPartition reads an assignment written by savePartition, every intersection must be listed */
+bool loadPartition(const char *path, Intersection *inter_ptr, int num_intersections, int parts, std::vector<int>& assignment)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "loadPartition [ERROR]: Failed to open " << path << std::endl;
+        return false;
+    }
+
+    assignment.assign(num_intersections, -1);
+    std::string line;
+    while (getline(file, line))
+    {
+        std::stringstream ss(line);
+        std::string name;
+        int part;
+        if (!(ss >> name >> part))
+        {
+            continue;
+        }
+        Intersection *found = findIntersectionbyID(name.c_str(), inter_ptr, num_intersections);
+        if (found == nullptr || part < 0 || part >= parts)
+        {
+            std::cerr << "loadPartition [ERROR]: Bad line in " << path << ": " << line << std::endl;
+            return false;
+        }
+        assignment[found->index] = part;
+    }
+
+    for (int i = 0; i < num_intersections; i++)
+    {
+        if (assignment[i] == -1)
+        {
+            std::cerr << "loadPartition [ERROR]: " << inter_ptr[i].name << " is missing from " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/* printSummary prints loads and cut hops of an assignment */
+static void printSummary(const char *label, const PartitionSummary& summary)
+{
+    std::cout << "  " << label << ": cut " << summary.cutHops << " of " << summary.totalHops << " hops, loads [";
+    for (size_t p = 0; p < summary.loads.size(); p++)
+    {
+        std::cout << (p ? ", " : "") << summary.loads[p];
+    }
+    std::cout << "]" << std::endl;
+}
+
+/*
+* setupPartition decides which shard or worker owns each intersection: loaded from a file,
+* computed from the routes (default) or round robin. The computed one is compared against
+* round robin and can be saved with --partition-out.
+*/
+bool setupPartition(const std::vector<std::vector<int>>& routes, Intersection *inter_ptr, int num_intersections)
+{
+    int parts = std::max(simConfig.shards, simConfig.threads);
+    intersectionPart.clear(); // a daemon worker may have partitioned a different table before
+    if (parts < 2)
+    {
+        return true;
+    }
+
+    std::vector<int> roundRobin(num_intersections);
+    for (int i = 0; i < num_intersections; i++)
+    {
+        roundRobin[i] = i % parts;
+    }
+
+    if (strcmp(simConfig.partition, "roundrobin") == 0)
+    {
+        intersectionPart = roundRobin;
+    }
+    else if (strcmp(simConfig.partition, "auto") == 0)
+    {
+        intersectionPart = partitionIntersections(routes, num_intersections, parts);
+    }
+    else if (!loadPartition(simConfig.partition, inter_ptr, num_intersections, parts, intersectionPart))
+    {
+        return false;
+    }
+
+    std::cout << "Intersection partition (" << parts << " parts, " << simConfig.partition << "):" << std::endl;
+    printSummary("this run   ", summarizePartition(routes, intersectionPart, parts));
+    printSummary("round robin", summarizePartition(routes, roundRobin, parts));
+
+    if (simConfig.partitionOut != nullptr && !savePartition(simConfig.partitionOut, inter_ptr, intersectionPart))
+    {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+/*  Group G
+    Date: 4/29/2025
+    Program Description: Intersection partitioner. Builds the co-usage graph of the
+    intersections from the parsed routes (an edge for every consecutive pair of hops,
+    weighted by how often that pair occurs) and splits it into balanced parts that
+    cut as few hops as possible, so a train crossing between two intersections
+    usually talks to one shard or one worker. The assignment can be written to a
+    file and loaded again with --partition=FILE.
+*/
+
+#ifndef PARTITIONER_H
+#define PARTITIONER_H
+
+#include <vector>
+
+#include "Resource_Allocation.h"
+
+// Quality of an assignment
+struct PartitionSummary {
+    long totalHops = 0;          // consecutive hop pairs over all routes
+    long cutHops = 0;            // pairs whose two intersections are in different parts
+    std::vector<long> loads;     // route visits per part
+};
+
+// Split the intersections into parts, routes[t] is train t's route as intersection indices
+std::vector<int> partitionIntersections(const std::vector<std::vector<int>>& routes, int num_intersections, int parts);
+
+// Measure an assignment against the routes
+PartitionSummary summarizePartition(const std::vector<std::vector<int>>& routes, const std::vector<int>& assignment, int parts);
+
+// Write / read an assignment as "IntersectionName part" lines
+bool savePartition(const char *path, const Intersection *inter_ptr, const std::vector<int>& assignment);
+bool loadPartition(const char *path, Intersection *inter_ptr, int num_intersections, int parts, std::vector<int>& assignment);
+
+// Compute or load the assignment for simConfig (shards or threads) and print its summary
+bool setupPartition(const std::vector<std::vector<int>>& routes, Intersection *inter_ptr, int num_intersections);
+
+// Part that owns an intersection, round robin until setupPartition has run
+int partitionOf(int intersectionIdx);
+
+#endif
@@ -0,0 +1,365 @@
+/*  Group G
+    Date: 4/22/2025
+    Program Description: Command line parsing for the railway simulation options.
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include "SimConfig.h"
+
+SimConfig simConfig;
+
+/*
+* parseLogCategories reads a comma separated list of log categories (or "all") into a mask
+* input: the list, e.g. "grant,deadlock"
+* output: the mask, 0 if a name is unknown
+*/
+static unsigned parseLogCategories(const char *list)
+{
+    static const struct { const char *name; unsigned mask; } names[] = {
+        {"protocol", LogCategory::PROTOCOL}, {"grant", LogCategory::GRANT}, {"wait", LogCategory::WAIT},
+        {"deadlock", LogCategory::DEADLOCK}, {"server", LogCategory::SERVER}, {"all", LogCategory::ALL}};
+
+    unsigned mask = 0;
+    while (*list != '\0')
+    {
+        size_t length = strcspn(list, ",");
+        unsigned found = 0;
+        for (const auto &entry : names)
+        {
+            if (strlen(entry.name) == length && strncmp(list, entry.name, length) == 0)
+            {
+                found = entry.mask;
+            }
+        }
+        if (found == 0)
+        {
+            return 0;
+        }
+        mask |= found;
+        list += length;
+        if (*list == ',')
+        {
+            list++;
+        }
+    }
+    return mask;
+}
+
+/*
+* parseSimConfig reads the command line into simConfig
+* input: argc and argv from main
+* output: returns false if an option is unknown or malformed
+*/
+bool parseSimConfig(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--deferred-grant") == 0)
+        {
+            simConfig.deferredGrant = true;
+        }
+        else if (strcmp(arg, "--pipeline") == 0)
+        {
+            simConfig.pipeline = true;
+        }
+        else if (strcmp(arg, "--handoff") == 0)
+        {
+            simConfig.handoff = true;
+        }
+        else if (strncmp(arg, "--batch=", 8) == 0)
+        {
+            simConfig.batchSize = atoi(arg + 8);
+            if (simConfig.batchSize < 1)
+            {
+                std::cerr << "parseSimConfig [ERROR]: batch size must be at least 1" << std::endl;
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--shards=", 9) == 0)
+        {
+            simConfig.shards = atoi(arg + 9);
+            if (simConfig.shards < 1)
+            {
+                std::cerr << "parseSimConfig [ERROR]: shard count must be at least 1" << std::endl;
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--threads=", 10) == 0)
+        {
+            simConfig.threads = atoi(arg + 10);
+            if (simConfig.threads < 1)
+            {
+                std::cerr << "parseSimConfig [ERROR]: thread count must be at least 1" << std::endl;
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--partition=", 12) == 0)
+        {
+            simConfig.partition = arg + 12;
+        }
+        else if (strncmp(arg, "--partition-out=", 16) == 0)
+        {
+            simConfig.partitionOut = arg + 16;
+        }
+        else if (strcmp(arg, "--busy-poll") == 0)
+        {
+            simConfig.busyPoll = true;
+        }
+        else if (strncmp(arg, "--busy-poll=", 12) == 0)
+        {
+            simConfig.busyPoll = true;
+            simConfig.busyPollCpu = atoi(arg + 12);
+        }
+        else if (strncmp(arg, "--busy-poll-idle-us=", 20) == 0)
+        {
+            simConfig.busyPollIdleUs = atoi(arg + 20);
+        }
+        else if (strcmp(arg, "--transport=queue") == 0)
+        {
+            simConfig.transport = Transport::QUEUE;
+        }
+        else if (strcmp(arg, "--transport=mailbox") == 0)
+        {
+            simConfig.transport = Transport::MAILBOX;
+        }
+        else if (strcmp(arg, "--transport=socket") == 0)
+        {
+            simConfig.transport = Transport::SOCKET;
+        }
+        else if (strncmp(arg, "--socket=", 9) == 0)
+        {
+            simConfig.socketPath = arg + 9;
+        }
+        else if (strncmp(arg, "--client=", 9) == 0)
+        {
+            // a client always talks to a socket server
+            simConfig.clientTrain = arg + 9;
+            simConfig.transport = Transport::SOCKET;
+        }
+        else if (strcmp(arg, "--daemon") == 0)
+        {
+            simConfig.daemonWorkers = 1;
+        }
+        else if (strncmp(arg, "--daemon=", 9) == 0)
+        {
+            simConfig.daemonWorkers = atoi(arg + 9);
+            if (simConfig.daemonWorkers < 1)
+            {
+                std::cerr << "parseSimConfig [ERROR]: daemon worker count must be at least 1" << std::endl;
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--daemon-socket=", 16) == 0)
+        {
+            simConfig.daemonSocket = arg + 16;
+        }
+        else if (strncmp(arg, "--submit=", 9) == 0)
+        {
+            simConfig.submitDir = arg + 9;
+        }
+        else if (strcmp(arg, "--event-loop") == 0)
+        {
+            simConfig.eventLoop = true;
+        }
+        else if (strncmp(arg, "--wait-retry-ms=", 16) == 0)
+        {
+            simConfig.waitRetryMs = atoi(arg + 16);
+        }
+        else if (strncmp(arg, "--deadlock-tick-ms=", 19) == 0)
+        {
+            simConfig.deadlockTickMs = atoi(arg + 19);
+        }
+        else if (strcmp(arg, "--log-level=none") == 0)
+        {
+            simConfig.logLevel = LogLevel::NONE;
+        }
+        else if (strcmp(arg, "--log-level=info") == 0)
+        {
+            simConfig.logLevel = LogLevel::INFO;
+        }
+        else if (strcmp(arg, "--log-level=debug") == 0)
+        {
+            simConfig.logLevel = LogLevel::DEBUG;
+        }
+        else if (strncmp(arg, "--log-categories=", 17) == 0)
+        {
+            simConfig.logCategories = parseLogCategories(arg + 17);
+            if (simConfig.logCategories == 0)
+            {
+                std::cerr << "parseSimConfig [ERROR]: log categories are protocol, grant, wait, deadlock, server or all" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--no-log-console") == 0)
+        {
+            simConfig.logConsole = false;
+        }
+        else if (strcmp(arg, "--log-format=text") == 0)
+        {
+            simConfig.logFormat = LogFormat::TEXT;
+        }
+        else if (strcmp(arg, "--log-format=binary") == 0)
+        {
+            simConfig.logFormat = LogFormat::BINARY;
+        }
+        else if (strncmp(arg, "--log-ring=", 11) == 0)
+        {
+            simConfig.logRingSlots = atoi(arg + 11);
+            if (simConfig.logRingSlots < 0)
+            {
+                std::cerr << "parseSimConfig [ERROR]: log ring size cannot be negative" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--sync-log") == 0)
+        {
+            simConfig.asyncLog = false;
+        }
+        else if (strncmp(arg, "--log-flush-bytes=", 18) == 0)
+        {
+            simConfig.logFlushBytes = atoi(arg + 18);
+            if (simConfig.logFlushBytes < 1)
+            {
+                std::cerr << "parseSimConfig [ERROR]: log flush size must be at least 1 byte" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--log-writer=thread") == 0)
+        {
+            simConfig.logWriter = LogWriter::THREAD;
+        }
+        else if (strcmp(arg, "--log-writer=uring") == 0)
+        {
+            simConfig.logWriter = LogWriter::URING;
+        }
+        else if (strncmp(arg, "--log-flush-ms=", 15) == 0)
+        {
+            simConfig.logFlushMs = atoi(arg + 15);
+        }
+        else if (strncmp(arg, "--log-budget=", 13) == 0)
+        {
+            simConfig.logBudget = atoi(arg + 13);
+            if (simConfig.logBudget < 0)
+            {
+                std::cerr << "parseSimConfig [ERROR]: log budget cannot be negative" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--log-overflow=block") == 0)
+        {
+            simConfig.logOverflow = LogOverflow::BLOCK;
+        }
+        else if (strcmp(arg, "--log-overflow=drop") == 0)
+        {
+            simConfig.logOverflow = LogOverflow::DROP;
+        }
+        else if (strcmp(arg, "--log-overflow=sample") == 0)
+        {
+            simConfig.logOverflow = LogOverflow::SAMPLE;
+        }
+        else if (strcmp(arg, "--log-overflow=spill") == 0)
+        {
+            simConfig.logOverflow = LogOverflow::SPILL;
+        }
+        else if (strncmp(arg, "--log-sample=", 13) == 0)
+        {
+            simConfig.logSampleEvery = atoi(arg + 13);
+            if (simConfig.logSampleEvery < 1)
+            {
+                std::cerr << "parseSimConfig [ERROR]: log sample rate must be at least 1" << std::endl;
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--log-spill-max=", 16) == 0)
+        {
+            simConfig.logSpillMax = atoi(arg + 16);
+        }
+        else
+        {
+            std::cerr << "parseSimConfig [ERROR]: unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    // the daemon takes its simulation options from every job, a submitted job cannot start another daemon
+    if (simConfig.daemonWorkers > 0 && (simConfig.submitDir != nullptr || simConfig.clientTrain != nullptr))
+    {
+        std::cerr << "parseSimConfig [ERROR]: --daemon cannot be combined with --submit or --client" << std::endl;
+        return false;
+    }
+    if (simConfig.submitDir != nullptr && simConfig.transport == Transport::SOCKET)
+    {
+        std::cerr << "parseSimConfig [ERROR]: daemon jobs fork their trains, --transport=socket is not supported" << std::endl;
+        return false;
+    }
+
+    // shards have their own request queues, the other transports and the doorbells are per server
+    if (simConfig.shards > 1 && (simConfig.transport != Transport::QUEUE || simConfig.eventLoop))
+    {
+        std::cerr << "parseSimConfig [ERROR]: --shards needs --transport=queue and the blocking server loop" << std::endl;
+        return false;
+    }
+
+    // busy polling replaces the blocking receive of the single-threaded loop
+    if (simConfig.busyPoll && (simConfig.eventLoop || simConfig.threads > 1 || simConfig.shards > 1))
+    {
+        std::cerr << "parseSimConfig [ERROR]: --busy-poll needs the single-threaded blocking server loop" << std::endl;
+        return false;
+    }
+
+    if (simConfig.threads > 1)
+    {
+        // workers send responses concurrently, only the message queues are safe for that
+        if (simConfig.transport != Transport::QUEUE || simConfig.eventLoop || simConfig.shards > 1)
+        {
+            std::cerr << "parseSimConfig [ERROR]: --threads needs --transport=queue, no --event-loop and no --shards" << std::endl;
+            return false;
+        }
+        // the wait queue is one serialized retry pass, parked lists are per intersection and fit the per-intersection locks
+        simConfig.deferredGrant = true;
+    }
+    return true;
+}
+
+/* printUsage prints the supported options to stderr */
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --deferred-grant     park busy ACQUIREs on the server and reply with one GRANT\n"
+              << "  --pipeline           request the next intersection while crossing the current one\n"
+              << "  --handoff            release a hop and acquire the next one with a single HANDOFF\n"
+              << "  --batch=N            take up to N queued requests per server wake-up (default 16)\n"
+              << "  --transport=T        request transport: queue (default), mailbox or socket\n"
+              << "  --socket=PATH        socket transport: server socket path (default railway.sock)\n"
+              << "  --client=TRAIN       run as the external client for TRAIN of a socket server\n"
+              << "  --daemon[=N]         run as a daemon with N pre-forked workers (default 1) taking scenario jobs\n"
+              << "  --daemon-socket=PATH daemon socket to listen on or submit to (default railwayd.sock)\n"
+              << "  --submit=DIR         run the scenario in DIR (DIR/data/*.txt) on the daemon with the other options\n"
+              << "  --threads=N          decide requests on N worker threads with work stealing (implies --deferred-grant)\n"
+              << "  --shards=N           split the intersections across N server processes (default 1)\n"
+              << "  --partition=P        intersection owners for shards/threads: auto (default), roundrobin or a file\n"
+              << "  --partition-out=FILE write the intersection assignment to FILE\n"
+              << "  --busy-poll[=CPU]    spin on the request source (pinned to CPU if given) instead of blocking\n"
+              << "  --busy-poll-idle-us=N busy poll: block again after N us without a request (default 5000)\n"
+              << "  --event-loop         run the server as one epoll loop (doorbells, timers, signalfd)\n"
+              << "  --wait-retry-ms=N    event loop: wait-queue retry interval, 0 disables (default 1000)\n"
+              << "  --deadlock-tick-ms=N event loop: deadlock detection interval, 0 disables (default 1000)\n"
+              << "  --log-level=L        none, info (grants, deadlocks, routes) or debug (everything, default)\n"
+              << "  --log-categories=C   comma separated: protocol, grant, wait, deadlock, server or all (default)\n"
+              << "  --no-log-console     write log lines to data/simulation.log only, not to the console\n"
+              << "  --log-format=F       text (default) or binary: event records in data/simulation.bin, read with LogDecode\n"
+              << "  --log-ring=N         records in each train's shared-memory log ring, 0 uses the log queue (default 256)\n"
+              << "  --sync-log           write server log lines directly instead of through the logger thread\n"
+              << "  --log-flush-bytes=N  logger thread: write once N bytes are buffered (default 65536)\n"
+              << "  --log-flush-ms=N     logger thread: write at least every N ms, 0 disables (default 100)\n"
+              << "  --log-writer=W       logger thread output: thread (write calls, default) or uring (io_uring)\n"
+              << "  --log-budget=N       log lines per second before wait events are summarized, 0 never (default 20000)\n"
+              << "  --log-overflow=P     full log queue: block (default), drop, sample or spill\n"
+              << "  --log-sample=N       sample policy: keep 1 in N log messages while full (default 10)\n"
+              << "  --log-spill-max=N    spill policy: log messages buffered per process (default 1024)\n";
+}
@@ -0,0 +1,139 @@
+/*  Group G
+    Date: 4/22/2025
+    Program Description: Run-time options for the railway simulation. main parses
+    the command line into simConfig before anything is forked, so the server and
+    every train process see the same settings.
+*/
+
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+// How trains send requests to the server and get responses back
+enum class Transport {
+    QUEUE,      // System V request/response message queues
+    MAILBOX,    // per-train mailbox slots in shared memory with a ready bitmap
+    SOCKET      // Unix-domain socket, trains are external clients instead of forked children
+};
+
+// What a sender does with a log message when the log queue (or its log ring) is full
+enum class LogOverflow {
+    BLOCK,      // wait for room (the stall is timed and reported)
+    DROP,       // drop the message and count it
+    SAMPLE,     // keep one in every logSampleEvery messages, drop the rest
+    SPILL       // keep it in a per-process buffer and send it once there is room
+};
+
+// How the logger thread writes its buffer out
+enum class LogWriter {
+    THREAD,     // write() calls on the logger thread
+    URING       // io_uring with registered buffers and fixed files, falls back to THREAD
+};
+
+// How log output is stored
+enum class LogFormat {
+    TEXT,       // timestamped lines in data/simulation.log (and on the console)
+    BINARY      // fixed-size event records in data/simulation.bin, rendered later by LogDecode
+};
+
+// Log verbosity: an event is logged if its level is at most simConfig.logLevel
+namespace LogLevel {
+    const int NONE = 0;          // nothing is logged
+    const int INFO = 1;          // grants, releases, deadlocks, trains starting and finishing
+    const int DEBUG = 2;         // every request, response and WAIT retry as well
+}
+
+// Log categories, simConfig.logCategories is a mask of them
+namespace LogCategory {
+    const unsigned PROTOCOL = 1; // requests sent and responses received by trains
+    const unsigned GRANT = 2;    // intersections granted, acquired, released and handed off
+    const unsigned WAIT = 4;     // WAIT/DECLINED responses, queued and parked requests, retries
+    const unsigned DEADLOCK = 8; // cycles found and trains preempted
+    const unsigned SERVER = 16;  // setup, trains completing or abandoning their route
+    const unsigned ALL = 31;
+}
+
+struct SimConfig {
+    Transport transport = Transport::QUEUE;
+    const char *socketPath = "railway.sock";   // socket transport: where the server listens
+    const char *clientTrain = nullptr;         // run as the external client for this train instead of the server
+
+    // Daemon mode: keep daemonWorkers pre-forked workers and run scenario jobs sent to daemonSocket,
+    // or submit the scenario in submitDir to a running daemon and print its summary
+    int daemonWorkers = 0;                     // 0 = run one simulation in this directory
+    const char *daemonSocket = "railwayd.sock";
+    const char *submitDir = nullptr;
+
+
+    // Protocol: park contended ACQUIREs on the server and answer each with a single
+    // GRANT once capacity frees up, instead of WAIT + wait queue retries
+    bool deferredGrant = false;
+
+    // Trains request their next intersection while still crossing the current one,
+    // so the grant is usually waiting for them when the crossing ends
+    bool pipeline = false;
+
+    // Trains send one HANDOFF (release this hop, acquire the next) instead of RELEASE + ACQUIRE
+    bool handoff = false;
+
+    // Most requests the server takes per wake-up (the first one blocks, the rest are
+    // taken only if already queued) and decides before flushing responses and logs
+    int batchSize = 16;
+
+    // Server processes the intersection table is split across (queue transport, blocking loop)
+    int shards = 1;
+
+    // Worker threads deciding requests under per-intersection locks (1 = single-threaded loop)
+    int threads = 1;
+
+    // Which shard/worker owns each intersection: auto (from the routes), roundrobin or a file
+    const char *partition = "auto";
+    const char *partitionOut = nullptr;   // write the assignment used to this file
+
+    // Busy-poll the request source instead of blocking, optionally pinned to one CPU, and
+    // block again after busyPollIdleUs without a request
+    bool busyPoll = false;
+    int busyPollCpu = -1;
+    int busyPollIdleUs = 5000;
+
+    // Run the server as one epoll loop over request/log doorbells, timers and child exits
+    bool eventLoop = false;
+    int waitRetryMs = 1000;      // event loop: wait-queue retry timer, 0 disables it
+    int deadlockTickMs = 1000;   // event loop: deadlock detection tick, 0 disables it
+
+    // Server log output goes through a logger thread with a double buffer, flushed in one write once
+    // it holds logFlushBytes or every logFlushMs (0 = size only); false writes every batch directly
+    bool asyncLog = true;
+    int logFlushBytes = 64 * 1024;
+    int logFlushMs = 100;
+    LogWriter logWriter = LogWriter::THREAD;
+
+    // What is logged (--log-level, --log-categories) and whether log lines are echoed to the console
+    int logLevel = LogLevel::DEBUG;
+    unsigned logCategories = LogCategory::ALL;
+    bool logConsole = true;
+
+    // Text lines, or binary event records the trains and server fill in without formatting anything
+    LogFormat logFormat = LogFormat::TEXT;
+
+    // Records in each forked train's log ring (0 = trains send log messages over the log queue)
+    int logRingSlots = 256;
+
+    // Log lines per second the server takes before trains and server summarize their wait events
+    // instead of logging each one (0 = never sample)
+    int logBudget = 20000;
+
+    // Log queue overflow handling
+    LogOverflow logOverflow = LogOverflow::BLOCK;
+    int logSampleEvery = 10;     // sample: keep 1 in N messages while the queue is full
+    int logSpillMax = 1024;      // spill: messages a process buffers before it starts dropping
+};
+
+// Parse command line options into simConfig, returns false on an unknown option
+bool parseSimConfig(int argc, char *argv[]);
+
+// Print the supported options
+void printUsage(const char *program);
+
+extern SimConfig simConfig;
+
+#endif
@@ -25,10 +25,21 @@
 #include <sys/wait.h>
 #include <algorithm>
 #include <sys/file.h>
+#include <sched.h>
 
 #include "shared_Mem.h"
 #include "TrainCommunication.h"
 #include "trainCommExtension.h" // included for logging and wait queueing
+#include "SimConfig.h"
+#include "DeadlockDetection.h"
+#include "serverEventLoop.h"
+#include "trainMailbox.h"
+#include "queueTelemetry.h"
+#include "trainSocket.h"
+#include "serverShards.h"
+#include "serverLogger.h"
+#include "logRing.h"
+#include "logSampler.h"
 
 
 
@@ -38,30 +49,43 @@
 // We define this in main.cpp (so only one definition in the whole project):
 extern shared_mem_t *shm_ptr; // Pointer to shared memory
 
+// Function to read the simulated time for a log line or event
+static int currentSimulatedTime() {
+    // a timestamp only needs some recent value, writers advance the clock with atomic adds
+    return __atomic_load_n(&shm_ptr->simulatedTime, __ATOMIC_RELAXED);
+}
+
 // Function to get formatted timestamp
 std::string getTimestamp() {
+    return formatTimestamp(currentSimulatedTime());
+}
 
-    int time;
-    pthread_mutex_lock(&shm_ptr->rat_mutex);
-    time = shm_ptr->simulatedTime; // Get the simulated time from shared memory
-    pthread_mutex_unlock(&shm_ptr->rat_mutex);
+// Function to format a simulated time as hh:mm:ss
+std::string formatTimestamp(int time) {
+    char stamp[24];
+    size_t length = formatLogStamp(stamp, time);
+    return std::string(stamp + 1, length - 3); // without "[" and "] "
+}
 
-    int hours = time / 3600;
-    int minutes = (time % 3600) / 60;
-    int seconds = time % 60;
-    
-    std::stringstream ss;
-    ss << std::setfill('0') << std::setw(2) << hours << ":"
-       << std::setfill('0') << std::setw(2) << minutes << ":"
-       << std::setfill('0') << std::setw(2) << seconds;
-    
-    return ss.str();
+// Function to add the timestamp to a log line
+std::string formatLogLine(const std::string& message) {
+    std::string line;
+    appendLogLine(line, currentSimulatedTime(), message.data(), message.size());
+    return line;
 }
 
-// Function to log a message to both console and file
-void logMessage(const std::string& message) {
-    std::string timestamped = "[" + getTimestamp() + "] " + message + "\n";
-    std::cout << timestamped;
+// Function to write already formatted log lines to both console and file with a single write
+void writeLogLines(const std::string& lines) {
+    if (lines.empty()) {
+        return;
+    }
+    // the logger thread writes console and file together in large writes
+    if (serverLoggerAppend(lines)) {
+        return;
+    }
+    if (simConfig.logConsole) {
+        std::cout << lines;
+    }
     char fileName[] = "data/simulation.log";
 
     int fd = open(fileName, O_WRONLY | O_APPEND);
@@ -76,7 +100,7 @@ void logMessage(const std::string& message) {
         return;
     }
 
-    write(fd, timestamped.c_str(), timestamped.size());
+    write(fd, lines.c_str(), lines.size());
     
    
     //    logFile << timestamped << std::endl;
@@ -84,9 +108,107 @@ void logMessage(const std::string& message) {
 
     flock(fd, LOCK_UN);
     close(fd);
+    serverStats.logWrites++;
     return;
 }
 
+// Function to log a message to both console and file
+void logMessage(const std::string& message) {
+    if (simConfig.logFormat == LogFormat::BINARY) {
+        std::string events;
+        appendTextEvent(events, currentSimulatedTime(), message.data(), message.size());
+        writeLogEvents(events);
+        return;
+    }
+    writeLogLines(formatLogLine(message));
+}
+
+// Event log for --log-format=binary, opened before the forks so every server process appends to it
+static int eventLogFd = -1;
+
+// Function to create the event log and write its header with the train and intersection names
+bool openEventLog(const char *path, const std::vector<std::string>& intersections) {
+    eventLogFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+    if (eventLogFd == -1) {
+        std::cerr << "openEventLog [ERROR]: Failed to open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (writeEventLogHeader(eventLogFd, trainNames, intersections) == -1) {
+        std::cerr << "openEventLog [ERROR]: Failed to write the header of " << path << std::endl;
+        closeEventLog();
+        return false;
+    }
+    return true;
+}
+
+// Function to close the event log
+void closeEventLog() {
+    if (eventLogFd != -1) {
+        close(eventLogFd);
+        eventLogFd = -1;
+    }
+}
+
+// Function to append event records to the event log with a single write (O_APPEND keeps the
+// writes of shards and worker threads whole)
+void writeLogEvents(const std::string& events) {
+    if (events.empty() || eventLogFd == -1) {
+        return;
+    }
+    if (write(eventLogFd, events.data(), events.size()) != (ssize_t)events.size()) {
+        std::cerr << "writeLogEvents [ERROR]: Failed to write event records: " << strerror(errno) << std::endl;
+    }
+    serverStats.logWrites++;
+}
+
+// Function to log one of the fixed events from the server outside a batch (logEvent checks it is enabled)
+void logEventUnchecked(uint8_t type, int trainIdx, int intersectionIdx, int otherIdx) {
+    EventRecord event = makeEvent(currentSimulatedTime(), type, trainIdx, intersectionIdx, otherIdx);
+    if (simConfig.logFormat == LogFormat::BINARY) {
+        writeLogEvents(std::string(reinterpret_cast<const char *>(&event), sizeof(event)));
+        return;
+    }
+    char text[EVENT_TEXT_MAX];
+    std::string line;
+    appendLogLine(line, event.time, text, renderEvent(text, sizeof(text), event, trainName, intersectionName));
+    writeLogLines(line);
+}
+
+
+// Train name for logging, trainIdx is the row in the held/waiting matrices
+const char* trainName(int trainIdx) {
+    if (trainIdx < 0 || trainIdx >= (int)trainNames.size()) {
+        return "UnknownTrain";
+    }
+    return trainNames[trainIdx].c_str();
+}
+
+// Intersection name for logging, intersectionIdx is the column in the held/waiting matrices
+const char* intersectionName(int intersectionIdx) {
+    // external socket clients only know the intersections of their own route
+    if (shm_ptr == nullptr) {
+        return socketIntersectionName(intersectionIdx);
+    }
+    if (intersectionIdx < 0 || intersectionIdx >= shm_ptr->num_intersections) {
+        return "UnknownIntersection";
+    }
+    char *mem_struct = reinterpret_cast<char *>(shm_ptr) + sizeof(shared_mem_t);
+    int *sem_val_block = reinterpret_cast<int *>(mem_struct);
+    pthread_mutex_t *mutex = reinterpret_cast<pthread_mutex_t *>(sem_val_block + shm_ptr->num_sem);
+    sem_t *semaphore = reinterpret_cast<sem_t *>(mutex + shm_ptr->num_mutex);
+    Intersection *inter_ptr = reinterpret_cast<Intersection *>(semaphore + shm_ptr->num_sem);
+    return inter_ptr[intersectionIdx].name;
+}
+
+// Train index for a train name such as "Train3", -1 if the train is unknown
+int findTrainIndex(const char* trainId) {
+    for (size_t i = 0; i < trainNames.size(); i++) {
+        if (trainNames[i] == trainId) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
 
 // Function to set up message queues
 int setupMessageQueues(int& requestQueue, int& responseQueue, int& logQueue, int& waitQueue) {
@@ -124,60 +246,128 @@ void cleanupMessageQueues(int requestQueue, int responseQueue, int logQueue, int
 
 // Damian
 // TO DO: create function to send log messages to server (follow message send format)
-bool sendLogMessage(int logQueue, const std::string& message) { 
+bool sendLogMessage(int logQueue, const char *message, size_t length) { 
+    // forked trains copy the message into their log ring, whole
+    if (logRingPush(message, length)) {
+        return true;
+    }
+
     LogMsg msg;
     msg.mtype = 1; // Response type for logging
    
-    strncpy(msg.message, message.c_str(), sizeof(msg.message) - 1);
-    msg.message[sizeof(msg.message) - 1] = '\0'; 
+    length = std::min(length, sizeof(msg.message) - 1);
+    memcpy(msg.message, message, length);
+    msg.message[length] = '\0'; 
 
-    if (msgsnd(logQueue, &msg, sizeof(LogMsg) - sizeof(long), 0) == -1) {
+    if (simConfig.transport == Transport::SOCKET) {
+        return socketSendLog(msg.message);
+    }
+
+    // a full log queue is handled by the overflow policy (block, drop, sample or spill)
+    if (!sendLogWithPolicy(logQueue, msg, &shm_ptr->logSend)) {
         perror("Failed to send log message");
         return false;
     }
     return true;
 }
 
+// Function to log one of the fixed train events: a binary record with --log-format=binary, else its text
+// (sendLogEvent checks it is enabled)
+bool sendLogEventUnchecked(int logQueue, uint8_t type, int trainIdx, int intersectionIdx, int otherIdx, int arg) {
+    // over the log budget: count the wait, trainLogSampledWaits logs the total when it ends
+    if (logSampleCandidate(type, arg) && logSamplingActive()) {
+        trainSampleWait(type, intersectionIdx);
+        return true;
+    }
+
+    // socket clients have no shared memory clock and send text lines over their socket
+    if (simConfig.logFormat == LogFormat::TEXT || simConfig.transport == Transport::SOCKET) {
+        // rendered on the stack, the ring or LogMsg copies it from there
+        EventRecord event = makeEvent(0, type, trainIdx, intersectionIdx, otherIdx, arg);
+        char text[EVENT_TEXT_MAX];
+        return sendLogMessage(logQueue, text, renderEvent(text, sizeof(text), event, trainName, intersectionName));
+    }
+
+    EventRecord event = makeEvent(currentSimulatedTime(), type, trainIdx, intersectionIdx, otherIdx, arg);
+    if (logRingPushEvent(event)) {
+        return true;
+    }
+
+    LogMsg msg;
+    msg.mtype = LOG_EVENT;
+    memcpy(msg.message, &event, sizeof(event));
+    if (!sendLogWithPolicy(logQueue, msg, &shm_ptr->logSend)) {
+        perror("Failed to send log event");
+        return false;
+    }
+    return true;
+}
+
+// Sequence number of the last request this train sent (each train process has its own copy)
+static uint32_t requestSeq = 0;
+
+// Function to hand a request to the server over the configured transport
+bool trainSendRequest(int requestQueue, const RequestMsg& msg) {
+    if (simConfig.transport == Transport::MAILBOX) {
+        return mailboxSendRequest(msg);
+    }
+    if (simConfig.transport == Transport::SOCKET) {
+        return socketSendRequest(msg);
+    }
+    if (simConfig.shards > 1) {
+        return shardSendRequest(msg);
+    }
+    if (!sendWithBackpressure(requestQueue, &msg, sizeof(msg) - sizeof(long), &shm_ptr->requestSend)) {
+        return false;
+    }
+    ringDoorbell(requestDoorbell);
+    return true;
+}
+
 // Function to send an ACQUIRE request
-bool trainSendAcquireRequest(int requestQueue, int logQueue, const char* trainId, const char* intersectionId) {
+bool trainSendAcquireRequest(int requestQueue, int logQueue, int trainIdx, int intersectionIdx, uint16_t flags) {
     RequestMsg msg;
 
 
     msg.mtype = RequestType::ACQUIRE;
-    strncpy(msg.train_id, trainId, sizeof(msg.train_id) - 1);
-    msg.train_id[sizeof(msg.train_id) - 1] = '\0';
-
-    strncpy(msg.intersection_id, intersectionId, sizeof(msg.intersection_id) - 1);
-    msg.intersection_id[sizeof(msg.intersection_id) - 1] = '\0';
+    msg.train_id = trainIdx;
+    msg.intersection_id = intersectionIdx;
+    msg.release_id = -1;
+    msg.flags = flags;
+    msg.seq = ++requestSeq;
     
-    if (msgsnd(requestQueue, &msg, sizeof(msg) - sizeof(long), 0) == -1) {
+    if (!trainSendRequest(requestQueue, msg)) {
         std::cerr << "Failed to send ACQUIRE request: " << strerror(errno) << std::endl;
         return false;
     }
     
-    sendLogMessage(logQueue, std::string(trainId) + ": Sent ACQUIRE request for " + intersectionId + ".");
+    if (flags & RequestFlag::LOOKAHEAD) {
+        sendLogEvent(logQueue, EventType::TRAIN_SENT_LOOKAHEAD, trainIdx, intersectionIdx);
+    } else {
+        sendLogEvent(logQueue, EventType::TRAIN_SENT_ACQUIRE, trainIdx, intersectionIdx);
+    }
     return true;
 }
 
 // Function to send a RELEASE request
-bool trainSendReleaseRequestExtended(int requestQueue, int logQueue, const char* trainId, const char* intersectionId, 
-    shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int *held) {
+bool trainSendReleaseRequestExtended(int requestQueue, int logQueue, int trainIdx, int intersectionIdx) {
     RequestMsg msg;
     
     msg.mtype = RequestType::RELEASE;
-    strncpy(msg.train_id, trainId, sizeof(msg.train_id) - 1);
-    msg.train_id[sizeof(msg.train_id) - 1] = '\0';
-    strncpy(msg.intersection_id, intersectionId, sizeof(msg.intersection_id) - 1);
-    msg.intersection_id[sizeof(msg.intersection_id) - 1] = '\0';
+    msg.train_id = trainIdx;
+    msg.intersection_id = intersectionIdx;
+    msg.release_id = -1;
+    msg.flags = 0;
+    msg.seq = ++requestSeq;
     
-    if (msgsnd(requestQueue, &msg, sizeof(msg) - sizeof(long), 0) == -1) {
+    if (!trainSendRequest(requestQueue, msg)) {
         std::cerr << "Failed to send RELEASE request: " << strerror(errno) << std::endl;
         return false;
     }
     else {
         // Log the release request
-        // **Moved to server side** releaseIntersection(shm, inter_ptr, sem, mutex, intersectionId, trainId, held);
-        sendLogMessage(logQueue, std::string(trainId) + ": Sent RELEASE request for " + intersectionId + ".");
+        // **Moved to server side** releaseIntersection(shm, inter_ptr, sem, mutex, intersectionIdx, trainIdx, held);
+        sendLogEvent(logQueue, EventType::TRAIN_SENT_RELEASE, trainIdx, intersectionIdx);
         return true;
     }
     
@@ -185,84 +375,134 @@ bool trainSendReleaseRequestExtended(int requestQueue, int logQueue, const char*
     return false;
 }
 
+// Function to send a HANDOFF request: release one intersection and acquire the next in a single message
+bool trainSendHandoffRequest(int requestQueue, int logQueue, int trainIdx, int releaseIdx, int acquireIdx) {
+    RequestMsg msg;
+
+    msg.mtype = RequestType::HANDOFF;
+    msg.train_id = trainIdx;
+    msg.intersection_id = acquireIdx;
+    msg.release_id = releaseIdx;
+    msg.flags = 0;
+    msg.seq = ++requestSeq;
+
+    if (!trainSendRequest(requestQueue, msg)) {
+        std::cerr << "Failed to send HANDOFF request: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    sendLogEvent(logQueue, EventType::TRAIN_SENT_HANDOFF, trainIdx, acquireIdx, releaseIdx);
+    return true;
+}
+
 // Function for trains to wait for a response from the server
-int trainWaitForResponse(int responseQueue, int logQueue, const char* trainId) {
+int trainWaitForResponse(int responseQueue, int logQueue, int trainIdx) {
     ResponseMsg msg;
     
-    // For debugging:
-    // std::cerr << "Received train ID: " << trainId << std::endl;
-    
-    // Convert train_id to a long for message filtering
-    std::string tempID = std::string(trainId);
-    if(tempID.size() <= 5 || !std::all_of(tempID.begin() + 5, tempID.end(), ::isdigit)) {
-        std::cerr << "Invalid train ID format: " << trainId << std::endl;
-        return -1;
+    // Receive response message specifically for this train (mtype is train index + 1)
+    if (simConfig.transport == Transport::MAILBOX) {
+        if (!mailboxReceiveResponse(trainIdx, msg)) {
+            return -1;
+        }
     }
-    long trainIdLong = std::stol(tempID.substr(5));
-    
-    // Receive response message specifically for this train
-    if (msgrcv(responseQueue, &msg, sizeof(msg) - sizeof(long), trainIdLong, 0) == -1) {
+    else if (simConfig.transport == Transport::SOCKET) {
+        if (!socketReceiveResponse(msg)) {
+            std::cerr << "Failed to receive response: server closed the connection" << std::endl;
+            return -1;
+        }
+    }
+    else if (msgrcv(responseQueue, &msg, sizeof(msg) - sizeof(long), trainIdx + 1, 0) == -1) {
         std::cerr << "Failed to receive response: " << strerror(errno) << std::endl;
         return -1;
     }
-
-    char tempIntersectionId[20];
-    strncpy(tempIntersectionId, msg.intersection_id, sizeof(msg.intersection_id) - 1);
-    tempIntersectionId[sizeof(msg.intersection_id) - 1] = '\0';
     
     // Log the response received
-    std::string responseTypeStr;
-    switch (msg.response_type) {
-        case ResponseType::GRANT:
-            responseTypeStr = "GRANT";
-            break;
-        case ResponseType::WAIT:
-            responseTypeStr = "WAIT";
-            break;
-        case ResponseType::DENY:
-            responseTypeStr = "DENY";
-            break;
-        default:
-            responseTypeStr = "UNKNOWN";
-    }
-    
-    sendLogMessage(logQueue, std::string(trainId) + ": Received " + responseTypeStr + " for " + tempIntersectionId + ".");
+    sendLogEvent(logQueue, EventType::TRAIN_RECEIVED, trainIdx, msg.intersection_id, -1, msg.response_type);
     
     return msg.response_type;
 }
 
 
+// Function to log the waits for an intersection that were counted instead of logged (--log-budget)
+void trainLogSampledWaits(int logQueue, int trainIdx, int intersectionIdx) {
+    int waits = trainTakeSampledWaits(intersectionIdx);
+    if (waits > 0) {
+        sendLogEvent(logQueue, EventType::WAIT_SUMMARY, trainIdx, intersectionIdx, std::min(waits, INT16_MAX), EventType::TRAIN_WAITING);
+    }
+}
+
+// Function to advance the simulated clock while a train backs off after a WAIT
+static void trainAdvanceSimulatedTime() {
+    if (simConfig.transport == Transport::SOCKET) {
+        // the clock lives in the server's shared memory
+        socketSendTick();
+        return;
+    }
+    // Update simulated time, atomic so the clock can be read without the mutex
+    __atomic_fetch_add(&shm_ptr->simulatedTime, 1, __ATOMIC_RELAXED);
+}
+
 // Function to simulate train movement
-void simulateTrainMovement(const char* trainId, const std::vector<std::string>& route, 
-                           int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm,
-                           Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex) 
+void simulateTrainMovement(int trainIdx, const std::vector<std::string>& route, 
+                           int requestQueue, int responseQueue, int logQueue, shared_mem_t *shm, Intersection *inter_ptr) 
 {
-    // Iterate through each intersection in the route
+    const char* trainId = trainName(trainIdx);
+
+    // Resolve the route to intersection indices once, so no names are sent to the server
+    std::vector<int> routeIdx;
     for (const auto& intersection : route) {
+        Intersection *found = findIntersectionbyID(intersection.c_str(), inter_ptr, shm->num_intersections);
+        if (found == nullptr) {
+            std::cerr << "Train " << trainId << " has unknown intersection in route: " << intersection << std::endl;
+            trainSendDoneMsg(requestQueue, trainIdx);
+            return;
+        }
+        routeIdx.push_back(found->index);
+    }
+
+    runTrainRoute(trainIdx, routeIdx, requestQueue, responseQueue, logQueue);
+}
+
+// Function to drive a train along its route (intersection indices), then send DONE
+void runTrainRoute(int trainIdx, const std::vector<int>& routeIdx, int requestQueue, int responseQueue, int logQueue)
+{
+    const char* trainId = trainName(trainIdx);
+    logRingAttach(trainIdx);
+
+    // in pipelined mode the ACQUIRE for a hop was already sent while crossing the previous one
+    bool requested = false;
+
+    // Iterate through each intersection in the route
+    for (size_t hop = 0; hop < routeIdx.size(); hop++) {
+        int intersectionIdx = routeIdx[hop];
         // Request to acquire the intersection
-        const char* tempIntersection = intersection.c_str();
-        if (!trainSendAcquireRequest(requestQueue, logQueue, trainId, tempIntersection)) {
+        if (!requested && !trainSendAcquireRequest(requestQueue, logQueue, trainIdx, intersectionIdx)) {
             std::cerr << "Train " << trainId << " failed to send ACQUIRE request." << std::endl;
             return;
         }
         
         // Wait for response from the server
-        std::string respIntersection;
         int response;
 
         // WAIT/DENY Handling
-        while ((response = trainWaitForResponse(responseQueue, logQueue, trainId)) != ResponseType::GRANT) {
+        while ((response = trainWaitForResponse(responseQueue, logQueue, trainIdx)) != ResponseType::GRANT) {
             if(response == ResponseType::WAIT) {
                 // If WAIT, log and continue waiting
-                sendLogMessage(logQueue, std::string(trainId) + ": Waiting for " + intersection + "...");
+                sendLogEvent(logQueue, EventType::TRAIN_WAITING, trainIdx, intersectionIdx);
                 sleep(1);
-                pthread_mutex_lock(&shm_ptr->rat_mutex); // Lock mutex
-                shm_ptr->simulatedTime++; // Update simulated time
-                pthread_mutex_unlock(&shm_ptr->rat_mutex); // Unlock mutex
+                trainAdvanceSimulatedTime();
+            }
+            else if (response == ResponseType::DECLINED) {
+                // lookahead refused, the previous hop is released now so ask again normally
+                if (!trainSendAcquireRequest(requestQueue, logQueue, trainIdx, intersectionIdx)) {
+                    std::cerr << "Train " << trainId << " failed to send ACQUIRE request." << std::endl;
+                    return;
+                }
             }
             else if (response == ResponseType::DENY) {
                 // If DENY, log and exit
-                sendLogMessage(logQueue, std::string(trainId) + ": DENIED access to " + intersection + ".");
+                trainLogSampledWaits(logQueue, trainIdx, intersectionIdx);
+                sendLogEvent(logQueue, EventType::TRAIN_DENIED, trainIdx, intersectionIdx);
                 return;
             }
 
@@ -273,9 +513,18 @@ void simulateTrainMovement(const char* trainId, const std::vector<std::string>&
 
         }
         // Intersection granted, simulate train crossing
-        sendLogMessage(logQueue, std::string(trainId) + ": Acquired " + intersection + ". Proceeding...");
-        
+        trainLogSampledWaits(logQueue, trainIdx, intersectionIdx);
+        sendLogEvent(logQueue, EventType::TRAIN_ACQUIRED, trainIdx, intersectionIdx);
         
+        // Pipelined: ask for the next hop now so the grant overlaps with this crossing
+        requested = false;
+        if (simConfig.pipeline && hop + 1 < routeIdx.size()) {
+            if (!trainSendAcquireRequest(requestQueue, logQueue, trainIdx, routeIdx[hop + 1], RequestFlag::LOOKAHEAD)) {
+                std::cerr << "Train " << trainId << " failed to send lookahead ACQUIRE request." << std::endl;
+                return;
+            }
+            requested = true;
+        }
 
 
 
@@ -288,16 +537,27 @@ void simulateTrainMovement(const char* trainId, const std::vector<std::string>&
         sleep(crossingTime);
         simulatedTime += crossingTime; // Update simulated time
         */
+        // Hand the intersection over for the next one in one message, unless the next one was already requested
+        if (simConfig.handoff && !requested && hop + 1 < routeIdx.size()) {
+            if (!trainSendHandoffRequest(requestQueue, logQueue, trainIdx, intersectionIdx, routeIdx[hop + 1])) {
+                std::cerr << "Train " << trainId << " failed to send HANDOFF request." << std::endl;
+                return;
+            }
+            requested = true;
+        }
         // Release the intersection
-        if (!trainSendReleaseRequestExtended(requestQueue, logQueue, trainId, tempIntersection, shm, inter_ptr, sem, mutex, held)) {
+        else if (!trainSendReleaseRequestExtended(requestQueue, logQueue, trainIdx, intersectionIdx)) {
             std::cerr << "Train " << trainId << " failed to send RELEASE request." << std::endl;
             return;
         }
   
     }
     
-    sendLogMessage(logQueue, std::string(trainId) + ": Completed route.");
-    trainSendDoneMsg(requestQueue, trainId);
+    sendLogEvent(logQueue, EventType::TRAIN_COMPLETED, trainIdx, -1);
+    if (simConfig.transport != Transport::SOCKET) {
+        flushLogSpill(logQueue, &shm_ptr->logSend);
+    }
+    trainSendDoneMsg(requestQueue, trainIdx);
     return;
 }
 
@@ -305,163 +565,595 @@ void simulateTrainMovement(const char* trainId, const std::vector<std::string>&
 * Server functions for handling requests
 */
 
-// Function to receive a request
-bool serverReceiveRequest(int requestQueue, char* trainId, char* intersectionId, int& requestType) {
-    RequestMsg req;
-    
-    // Receive any request message (both ACQUIRE and RELEASE)
-    if (msgrcv(requestQueue, &req, sizeof(req) - sizeof(long), 0, 0) == -1) {
-        if (errno == EINTR) {
-            // Interrupted by signal
-            return false;
+// Server counters, printed by printServerStats when the simulation ends
+ServerStats serverStats;
+
+// Function to receive a batch of requests: blocks for the first one (if block is set), then takes up to
+// maxRequests - 1 more that are already queued without blocking. Returns the number of requests received.
+int serverReceiveRequests(int requestQueue, RequestMsg* reqs, int maxRequests, bool block) {
+    int received = 0;
+
+    if (simConfig.transport == Transport::MAILBOX) {
+        received = mailboxReceiveRequests(reqs, maxRequests, block);
+    }
+    else if (simConfig.transport == Transport::SOCKET) {
+        received = socketReceiveRequests(reqs, maxRequests, block);
+        if (block && received > 0) {
+            // no request queue, the log and wait queues are sampled on wake-up
+            sampleQueueDepths();
+        }
+    }
+    while (simConfig.transport == Transport::QUEUE && received < maxRequests) {
+        int flags = (received == 0 && block) ? 0 : IPC_NOWAIT;
+        if (msgrcv(requestQueue, &reqs[received], sizeof(RequestMsg) - sizeof(long), 0, flags) == -1) {
+            if (errno == ENOMSG) {
+                // nothing else pending, the batch is complete
+                break;
+            }
+            if (errno != EINTR) {
+                // Interrupted by signal is not an error
+                std::cerr << "Failed to receive request: " << strerror(errno) << std::endl;
+            }
+            break;
+        }
+        received++;
+        if (block && received == 1) {
+            // woken by the first request, sample while the rest of the backlog is still queued
+            sampleQueueDepths();
         }
-        std::cerr << "Failed to receive request: " << strerror(errno) << std::endl;
-        return false;
     }
     
-    strncpy(trainId, req.train_id, sizeof(req.train_id) - 1);
-    trainId[sizeof(req.train_id) - 1] = '\0';
-    strncpy(intersectionId, req.intersection_id, sizeof(req.intersection_id) - 1);
-    intersectionId[sizeof(req.intersection_id) - 1] = '\0';
-    requestType = req.mtype;
-    
-    pthread_mutex_lock(&shm_ptr->rat_mutex);
-    shm_ptr->simulatedTime++;
-    pthread_mutex_unlock(&shm_ptr->rat_mutex);
+    // Update the clock and stats (an empty poll touches neither)
+    if (received > 0) {
+        __atomic_fetch_add(&shm_ptr->simulatedTime, received, __ATOMIC_RELAXED);
 
-    // Update simulated time
-    return true;
+        serverStats.requests += received;
+        serverStats.batches++;
+        if (received > serverStats.maxBatch) {
+            serverStats.maxBatch = received;
+        }
+    }
+    return received;
 }
 
+// Function to add a server log line to the batch, it is written together with the rest of the batch
+void serverQueueLog(ServerBatch& batch, const std::string& message) {
+    serverQueueLogAt(batch, currentSimulatedTime(), message.data(), message.size());
+}
 
-// Function to send a response
-bool serverSendResponse(int responseQueue, int logQueue, const char* trainId, 
-                        const char* intersectionId, int responseType) 
-{
-    ResponseMsg resp;
+// Function to add a server log line that is not a std::string (a received message) to the batch
+void serverQueueLog(ServerBatch& batch, const char *message, size_t length) {
+    serverQueueLogAt(batch, currentSimulatedTime(), message, length);
+}
 
-    std::string tempID = std::string(trainId);
+// Function to add a log line logged at an earlier simulated time (e.g. from a log ring) to the batch
+void serverQueueLogAt(ServerBatch& batch, int time, const char *message, size_t length) {
+    if (simConfig.logFormat == LogFormat::BINARY) {
+        appendTextEvent(batch.events, time, message, length);
+    } else {
+        appendLogLine(batch.logLines, time, message, length);
+    }
+    serverStats.logLines++;
+    batch.logged++;
+}
 
-    if (tempID.size() <= 5 || !std::all_of(tempID.begin() + 5, tempID.end(), ::isdigit)) {
-        std::cerr << "Invalid train ID format: " << tempID << std::endl;
-        return -1;
+// Function to add one of the fixed server events to the batch, as a record or as its log line
+// (serverQueueEvent checks it is enabled). Nothing is allocated once the batch buffers have grown.
+void serverQueueEventUnchecked(ServerBatch& batch, uint8_t type, int trainIdx, int intersectionIdx, int otherIdx) {
+    // over the log budget: count the wait, serverQueueSampledWaits logs the total when it ends
+    if (logSampleCandidate(type, 0) && logSamplingActive()) {
+        serverSampleWait(type, trainIdx, intersectionIdx);
+        return;
     }
+    EventRecord event = makeEvent(currentSimulatedTime(), type, trainIdx, intersectionIdx, otherIdx);
+    serverQueueEventRecord(batch, reinterpret_cast<const char *>(&event), sizeof(event));
+}
 
-    long trainIdLong = std::stol(tempID.substr(5));
+// Function to add an event record a train sent (log ring or log queue) to the batch
+void serverQueueEventRecord(ServerBatch& batch, const char *record, size_t size) {
+    EventRecord event;
+    if (size != sizeof(event)) {
+        std::cerr << "serverQueueEventRecord [ERROR]: event record of " << size << " bytes" << std::endl;
+        return;
+    }
+    memcpy(&event, record, sizeof(event));
+    if (simConfig.logFormat == LogFormat::BINARY) {
+        batch.events.append(record, size);
+    } else {
+        char text[EVENT_TEXT_MAX];
+        appendLogLine(batch.logLines, event.time, text, renderEvent(text, sizeof(text), event, trainName, intersectionName));
+    }
+    serverStats.logLines++;
+    batch.logged++;
+}
 
-    resp.mtype = trainIdLong;
-    resp.response_type = responseType;
-    strncpy(resp.intersection_id, intersectionId, sizeof(resp.intersection_id) - 1);
-    resp.intersection_id[sizeof(resp.intersection_id) - 1] = '\0';
-    
-    if (msgsnd(responseQueue, &resp, sizeof(resp) - sizeof(long), 0) == -1) {
-        std::cerr << "Failed to send response: " << strerror(errno) << std::endl;
-        return false;
+// Function to add the waits of a train that were counted instead of logged, once the wait is over
+// (intersectionIdx -1: waits for every intersection, the train has left)
+void serverQueueSampledWaits(ServerBatch& batch, int trainIdx, int intersectionIdx) {
+    SampledWait wait;
+    while (serverTakeSampledWait(trainIdx, intersectionIdx, wait)) {
+        if (logEnabled(EventType::WAIT_SUMMARY)) {
+            EventRecord event = makeEvent(currentSimulatedTime(), EventType::WAIT_SUMMARY, wait.train, wait.intersection,
+                std::min(wait.count, INT16_MAX), wait.type);
+            serverQueueEventRecord(batch, reinterpret_cast<const char *>(&event), sizeof(event));
+        }
     }
-    
-    // Log the response sent
-    std::string responseTypeStr;
-    switch (responseType) {
-        case ResponseType::GRANT:
-            responseTypeStr = "GRANTED";
-            break;
-        case ResponseType::WAIT:
-            responseTypeStr = "WAIT";
-            break;
-        case ResponseType::DENY:
-            responseTypeStr = "DENIED";
-            break;
-        default:
-            responseTypeStr = "UNKNOWN";
+}
+
+// Function to write the batched log lines and event records, each with a single write
+void serverWriteLogs(ServerBatch& batch) {
+    // the lines of every batch count against --log-budget, note when sampling starts or stops
+    int sampling = logSamplerAdd(batch.logged);
+    if (sampling != 0 && logEnabled(LogCategory::SERVER, LogLevel::INFO)) {
+        const char *note = sampling > 0 ? "SERVER: Log over budget, summarizing wait events."
+                                        : "SERVER: Log back under budget, logging every wait event.";
+        serverQueueLog(batch, note, strlen(note));
     }
+    batch.logged = 0;
+    writeLogLines(batch.logLines);
+    writeLogEvents(batch.events);
+    batch.logLines.clear();
+    batch.events.clear();
+}
+
+// Function to add a response to the batch, it is sent when the batch is flushed
+void serverQueueResponse(ServerBatch& batch, int trainIdx, int intersectionIdx, int responseType, uint32_t seq) 
+{
+    ResponseMsg resp;
+
+    resp.mtype = trainIdx + 1; // mtype must be greater than 0
+    resp.intersection_id = intersectionIdx;
+    resp.response_type = responseType;
+    resp.flags = 0;
+    resp.seq = seq;
+    batch.responses.push_back(resp);
     
+    // Log the response sent
     if (responseType == ResponseType::GRANT) {
-
-        sendLogMessage(logQueue, std::string("SERVER: ") + responseTypeStr + " " + intersectionId + " to " + trainId + ".");
+        serverQueueSampledWaits(batch, trainIdx, intersectionIdx);
+        serverQueueEvent(batch, EventType::SERVER_GRANTED, trainIdx, intersectionIdx);
     } else if (responseType == ResponseType::WAIT) {
         // log the wait. 
-        sendLogMessage(logQueue, std::string("SERVER: ") + intersectionId + " is busy. " + trainId + " added to wait queue.");
+        serverQueueEvent(batch, EventType::SERVER_QUEUED, trainIdx, intersectionIdx);
+    } else if (responseType == ResponseType::DECLINED) {
+        serverQueueEvent(batch, EventType::SERVER_DECLINED, trainIdx, intersectionIdx);
     }
     
-    pthread_mutex_lock(&shm_ptr->rat_mutex);
-    shm_ptr->simulatedTime++;
-    pthread_mutex_unlock(&shm_ptr->rat_mutex);
+    __atomic_fetch_add(&shm_ptr->simulatedTime, 1, __ATOMIC_RELAXED);
+}
 
-    return true;
+// Function to send the batched responses and write the batched log lines in one go
+bool serverFlushBatch(int responseQueue, ServerBatch& batch) {
+    bool ok = true;
+
+    for (const ResponseMsg& resp : batch.responses) {
+        if (simConfig.transport == Transport::MAILBOX) {
+            ok = mailboxSendResponse(resp) && ok;
+        }
+        else if (simConfig.transport == Transport::SOCKET) {
+            ok = socketSendResponse(resp) && ok;
+        }
+        else if (!sendWithBackpressure(responseQueue, &resp, sizeof(resp) - sizeof(long), &responseSend)) {
+            std::cerr << "Failed to send response: " << strerror(errno) << std::endl;
+            ok = false;
+        }
+    }
+    serverStats.responses += batch.responses.size();
+
+    // binary log: mark where the batch starts and how much follows, traces show it as a server span
+    if (!batch.events.empty() && !batch.responses.empty() && logEnabled(EventType::SERVER_BATCH)) {
+        EventRecord first;
+        memcpy(&first, batch.events.data(), sizeof(first));
+        int records = std::min<size_t>(batch.events.size() / sizeof(EventRecord), INT16_MAX);
+        int responses = std::min<size_t>(batch.responses.size(), UINT8_MAX);
+        EventRecord marker = makeEvent(first.time, EventType::SERVER_BATCH, -1, -1, records, responses);
+        batch.events.insert(0, reinterpret_cast<const char *>(&marker), sizeof(marker));
+    }
+    serverWriteLogs(batch);
+
+    batch.responses.clear();
+    return ok;
 }
 
-// function to handle train requests (acquire or release or deny access to intersection)
-void processTrainRequests(int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm, 
+/*
+* serverCheckNewWait looks for a cycle through the wait edge trainIdx just added; a new cycle has to
+* pass through it, so a deadlock is broken the moment it forms. Worker threads leave it to the deadlock
+* thread, which holds every intersection lock, and a shard does not own the other intersections of a cycle.
+*/
+static void serverCheckNewWait(ServerBatch& batch, int trainIdx, int intersectionIdx, int waitQueue, WaiterLists& waiters,
+    shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
+    DeadlockCycle cycle;
+    if (simConfig.threads > 1 || simConfig.shards > 1 || !findWaitCycle(shm, held, waiting, trainIdx, intersectionIdx, cycle)) {
+        return;
+    }
+    if (logEnabled(LogCategory::DEADLOCK, LogLevel::INFO)) {
+        serverQueueLog(batch, "SERVER: Deadlock detected! Cycle: " + formatCycle(cycle, inter_ptr));
+    }
+    // the preemption is logged directly, write the batch's lines before it
+    serverWriteLogs(batch);
+    breakDeadlock(shm, inter_ptr, cycle);
+    grantFreedCapacity(batch, waitQueue, waiters, shm, inter_ptr, held, sem, mutex, waiting);
+}
+
+// Function to handle an ACQUIRE: grant it, queue it or park it
+void serverHandleAcquire(ServerBatch& batch, const RequestMsg& req, int waitQueue, WaiterLists& waiters, shared_mem_t *shm,
     Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
-    char trainId[16];
-    char intersectionId[32];
-    int reqType;
-    int trainsDone = 0;
-    char log[100] = "\0";
-    bool waitQueueProcessed = false;
+    int trainIdx = req.train_id;
+    int intersectionIdx = req.intersection_id;
 
-    // Loop until msgrcv fails (e.g. when queue removed or signaled)
-    while (trainsDone < shm->num_trains) {
-        waitQueueProcessed = false;
+    // Grant the request
+    if(!checkIntersectionFull(shm, inter_ptr, intersectionIdx, held)) {
+        serverQueueResponse(batch, trainIdx, intersectionIdx, ResponseType::GRANT, req.seq);
+        lockIntersection(shm, inter_ptr, sem, mutex, intersectionIdx, trainIdx, held, waiting);
+        return;
+    }
 
-        if(processWaitQueue(waitQueue, trainId, intersectionId)) {
-            // Process wait queue
-            // waiting trains are always trying to acquire the intersection
+    // Shards check the wait edges of every shard, so the check and the new edge have to be one step
+    // across all of them: two shards that checked crossing lookaheads at once would both find no cycle.
+    // Only wait edges can close a cycle (a train is never waiting when it is granted), so this is enough.
+    if(simConfig.shards > 1) {
+        pthread_mutex_lock(&shm->wait_mutex);
+    }
+    if((req.flags & RequestFlag::LOOKAHEAD) && waitWouldDeadlock(shm, held, waiting, trainIdx, intersectionIdx)) {
+        // the train still holds its current hop, waiting here would close a cycle
+        serverQueueResponse(batch, trainIdx, intersectionIdx, ResponseType::DECLINED, req.seq);
+    }
+    else if(simConfig.deferredGrant){
+        // park the request, the train gets one GRANT when the intersection is released
+        parkRequest(waiters, trainIdx, intersectionIdx, req.seq, shm, inter_ptr, waiting);
+        serverQueueEvent(batch, EventType::SERVER_PARKED, trainIdx, intersectionIdx);
+        serverCheckNewWait(batch, trainIdx, intersectionIdx, waitQueue, waiters, shm, inter_ptr, held, sem, mutex, waiting);
+    }
+    else{
+        addToWaitQueue(waitQueue, trainIdx, intersectionIdx, req.seq, shm, inter_ptr, waiting);
+        serverQueueResponse(batch, trainIdx, intersectionIdx, ResponseType::WAIT, req.seq);
+        serverCheckNewWait(batch, trainIdx, intersectionIdx, waitQueue, waiters, shm, inter_ptr, held, sem, mutex, waiting);
+    }
+    if(simConfig.shards > 1) {
+        pthread_mutex_unlock(&shm->wait_mutex);
+    }
+}
 
-            // Grant the request
-            if(!checkIntersectionFull(shm, inter_ptr, intersectionId, held)) {
-                serverSendResponse(responseQueue, logQueue, trainId, intersectionId, ResponseType::GRANT);
-                lockIntersection(shm, inter_ptr, sem, mutex, intersectionId, trainId, held, waiting);
-                
-            }
-            else{
-                addToWaitQueue(waitQueue, trainId, intersectionId, shm, inter_ptr, waiting);
-                serverSendResponse(responseQueue, logQueue, trainId, intersectionId, ResponseType::WAIT);
-                break;
+// Function to retry the trains in the wait queue once, granting the ones whose intersection is free again.
+// Trains that are still blocked get another WAIT only if resendWait is set.
+void serverRetryWaitQueue(ServerBatch& batch, int waitQueue, shared_mem_t *shm, Intersection *inter_ptr, 
+    int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting, bool resendWait) {
+    struct msqid_ds info;
+    if (msgctl(waitQueue, IPC_STAT, &info) == -1) {
+        std::cerr << "processTrainRequests [ERROR]: Failed to read wait queue: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    // only look at the trains that were waiting before this pass, re-queued ones go to the back
+    int trainIdx;
+    int intersectionIdx;
+    uint32_t seq;
+    msgqnum_t entries = info.msg_qnum + spilledWaits();
+    for (msgqnum_t n = 0; n < entries; n++) {
+        if(!processWaitQueue(waitQueue, trainIdx, intersectionIdx, seq)) {
+            break;
+        }
+        // waiting trains are always trying to acquire the intersection
+        if(!checkIntersectionFull(shm, inter_ptr, intersectionIdx, held)) {
+            serverQueueResponse(batch, trainIdx, intersectionIdx, ResponseType::GRANT, seq);
+            lockIntersection(shm, inter_ptr, sem, mutex, intersectionIdx, trainIdx, held, waiting);
+        }
+        else{
+            // still busy, put it back
+            addToWaitQueue(waitQueue, trainIdx, intersectionIdx, seq, shm, inter_ptr, waiting);
+            if (resendWait) {
+                serverQueueResponse(batch, trainIdx, intersectionIdx, ResponseType::WAIT, seq);
             }
-            waitQueueProcessed = true;
         }
+    }
+}
 
-        if(!waitQueueProcessed){
-            if(!serverReceiveRequest(requestQueue, trainId, intersectionId, reqType)) {
-                std::cerr << "processTrainRequests [ERROR]: Failed to receive request." << std::endl;
-                continue;
-            }
+// Function to check a received request before any decision is made, malformed requests are dropped
+bool serverValidRequest(const RequestMsg& req, shared_mem_t *shm) {
+    if(req.train_id < 0 || req.train_id >= shm->num_trains) {
+        std::cerr << "processTrainRequests [ERROR]: Invalid train index " << req.train_id << std::endl;
+        return false;
+    }
+    if(req.mtype != RequestType::DONE && (req.intersection_id < 0 || req.intersection_id >= shm->num_intersections)) {
+        std::cerr << "processTrainRequests [ERROR]: Invalid intersection index " << req.intersection_id << std::endl;
+        return false;
+    }
+    if(req.mtype == RequestType::HANDOFF && (req.release_id < 0 || req.release_id >= shm->num_intersections)) {
+        std::cerr << "processTrainRequests [ERROR]: Invalid intersection index " << req.release_id << std::endl;
+        return false;
+    }
+    if(req.mtype != RequestType::ACQUIRE && req.mtype != RequestType::RELEASE && req.mtype != RequestType::DONE
+       && req.mtype != RequestType::HANDOFF) {
+        std::cerr << "Unknown request type: " << req.mtype << std::endl;
+        return false;
+    }
+    // a shard only decides for the intersections it owns
+    if(simConfig.shards > 1 && req.mtype != RequestType::DONE && (shardOf(req.intersection_id) != currentShard
+       || (req.mtype == RequestType::HANDOFF && shardOf(req.release_id) != currentShard))) {
+        std::cerr << "processTrainRequests [ERROR]: Shard " << currentShard << " got a request for "
+                  << intersectionName(req.intersection_id) << " it does not own" << std::endl;
+        return false;
+    }
+    return true;
+}
 
-        if(reqType == RequestType::ACQUIRE) {
-            // Grant the request
-            if(!checkIntersectionFull(shm, inter_ptr, intersectionId, held)) {
-                serverSendResponse(responseQueue, logQueue, trainId, intersectionId, ResponseType::GRANT);
-                lockIntersection(shm, inter_ptr, sem, mutex, intersectionId, trainId, held, waiting);
+// Function to handle a RELEASE (or the release half of a HANDOFF), parked trains get the freed capacity
+void serverHandleRelease(ServerBatch& batch, const RequestMsg& req, WaiterLists& waiters, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
+    int releaseIdx = (req.mtype == RequestType::HANDOFF) ? req.release_id : req.intersection_id;
 
-            }
-            else{
-                addToWaitQueue(waitQueue, trainId, intersectionId, shm, inter_ptr, waiting);
-                serverSendResponse(responseQueue, logQueue, trainId, intersectionId, ResponseType::WAIT);
+    // release the interesction and log it.
+    releaseIntersection(shm, inter_ptr, sem, mutex, releaseIdx, req.train_id, held);
+    serverQueueEvent(batch, EventType::SERVER_RELEASED, req.train_id, releaseIdx);
+
+    if(simConfig.deferredGrant) {
+        // hand the freed capacity straight to the parked trains
+        grantParkedRequests(waiters, releaseIdx, batch, shm, inter_ptr, sem, mutex, held, waiting);
+    }
+}
+
+// Function to decide a batch of received requests: releases first so the freed capacity goes to trains
+// that were already waiting, then acquires, then DONE messages. Responses and server log lines are added
+// to the batch, the caller flushes it. trainDone is set for every train that sent DONE.
+// Returns the number of DONE messages in the batch.
+int serverDecideBatch(ServerBatch& batch, RequestMsg* reqs, int received, int waitQueue, WaiterLists& waiters, std::vector<char>& trainDone,
+    shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
+    int done = 0;
+
+    // drop malformed requests before making any decisions
+    int valid = 0;
+    for (int r = 0; r < received; r++) {
+        if (serverValidRequest(reqs[r], shm)) {
+            reqs[valid++] = reqs[r];
+        }
+    }
+
+    // a HANDOFF is its release half followed by its acquire half, both decided in this batch
+    for (int r = 0; r < valid; r++) {
+        RequestMsg& req = reqs[r];
+        if (req.mtype != RequestType::HANDOFF) {
+            continue;
+        }
+        serverStats.handoffs++;
+        serverQueueEvent(batch, EventType::SERVER_HANDED_OFF, req.train_id, req.intersection_id, req.release_id);
+    }
+
+    // releases first
+    bool released = false;
+    for (int r = 0; r < valid; r++) {
+        const RequestMsg& req = reqs[r];
+        if (req.mtype != RequestType::RELEASE && req.mtype != RequestType::HANDOFF) {
+            continue;
+        }
+        serverHandleRelease(batch, req, waiters, shm, inter_ptr, held, sem, mutex, waiting);
+        released = true;
+    }
+
+    // trains that got WAIT can only move on after a release
+    if (released && !simConfig.deferredGrant) {
+        serverRetryWaitQueue(batch, waitQueue, shm, inter_ptr, held, sem, mutex, waiting, true);
+    }
+
+    // then acquires and DONE in arrival order
+    for (int r = 0; r < valid; r++) {
+        const RequestMsg& req = reqs[r];
+        if(req.mtype == RequestType::ACQUIRE || req.mtype == RequestType::HANDOFF) {
+            serverHandleAcquire(batch, req, waitQueue, waiters, shm, inter_ptr, held, sem, mutex, waiting);
+        }
+        else if(req.mtype == RequestType::DONE && !trainDone[req.train_id]) {
+            // Log the completion, every shard gets the DONE but only the first one logs it
+            trainDone[req.train_id] = 1;
+            done++;
+            if (simConfig.shards <= 1 || currentShard == 0) {
+                serverQueueEvent(batch, EventType::SERVER_TRAIN_DONE, req.train_id, -1);
             }
         }
-        else if (reqType == RequestType::RELEASE) {
-            // release the interesction and log it.
-            releaseIntersection(shm, inter_ptr, sem, mutex, intersectionId, trainId, held);
-            sendLogMessage(logQueue, std::string("SERVER: ") + trainId + " released " + intersectionId + ".");
-            
+    }
+    return done;
+}
+
+// Function to give capacity that was freed outside a RELEASE request to waiting trains
+void grantFreedCapacity(ServerBatch& batch, int waitQueue, WaiterLists& waiters, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
+    if (simConfig.deferredGrant) {
+        for (int i = 0; i < shm->num_intersections; i++) {
+            grantParkedRequests(waiters, i, batch, shm, inter_ptr, sem, mutex, held, waiting);
         }
-        else if(reqType == RequestType::DONE) {
-            // Log the completion
-            trainsDone++;
-            sendLogMessage(logQueue, std::string("SERVER: ") + trainId + " completed its route.");
+    }
+    else {
+        serverRetryWaitQueue(batch, waitQueue, shm, inter_ptr, held, sem, mutex, waiting, false);
+    }
+}
+
+// Function to take back everything a train held or waited for when it is gone without DONE (process
+// exited or client disconnected), so nobody waits on it forever. Returns 1 if the train is newly done.
+int serverAbandonTrain(ServerBatch& batch, int trainIdx, int waitQueue, WaiterLists& waiters, std::vector<char>& trainDone,
+    shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
+    if (trainDone[trainIdx]) {
+        return 0;
+    }
+    for (int i = 0; i < shm->num_intersections; i++) {
+        releaseIntersection(shm, inter_ptr, sem, mutex, i, trainIdx, held);
+        if (waiting[trainIdx * shm->num_intersections + i] == 1) {
+            waiting[trainIdx * shm->num_intersections + i] = 0;
+            waitGraphStopWaiting(trainIdx, i);
         }
-        else {
-            std::cerr << "Unknown request type: " << reqType << std::endl;
+        std::deque<ParkedRequest>& parked = waiters[i];
+        for (auto it = parked.begin(); it != parked.end();) {
+            it = (it->train_id == trainIdx) ? parked.erase(it) : it + 1;
         }
-        waitQueueProcessed = true;
+    }
+    trainDone[trainIdx] = 1;
+    serverStats.abandoned++;
+    serverQueueSampledWaits(batch, trainIdx, -1);
+    serverQueueEvent(batch, EventType::SERVER_ABANDONED, trainIdx, -1);
+    grantFreedCapacity(batch, waitQueue, waiters, shm, inter_ptr, held, sem, mutex, waiting);
+    return 1;
+}
 
-        
+// Function to abandon the trains whose socket client disconnected, returns how many are newly done
+int serverAbandonDisconnected(ServerBatch& batch, int waitQueue, WaiterLists& waiters, std::vector<char>& trainDone,
+    shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
+    if (simConfig.transport != Transport::SOCKET) {
+        return 0;
+    }
+    int done = 0;
+    std::vector<int> gone;
+    socketTakeDisconnected(gone);
+    for (int trainIdx : gone) {
+        done += serverAbandonTrain(batch, trainIdx, waitQueue, waiters, trainDone, shm, inter_ptr, held, sem, mutex, waiting);
+    }
+    return done;
+}
+
+// Per-request service time of every batch in nanoseconds (receive returned -> responses and logs flushed)
+static std::vector<long> serviceTimes;
+
+// Function to read the monotonic clock in nanoseconds
+static long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Function to pin the server to simConfig.busyPollCpu, if one was given
+static void serverPinToCpu() {
+    if (simConfig.busyPollCpu < 0) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(simConfig.busyPollCpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+        std::cerr << "serverPinToCpu [ERROR]: Failed to pin the server to CPU " << simConfig.busyPollCpu << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    std::cout << "Server busy-polling on CPU " << simConfig.busyPollCpu << std::endl;
+}
+
+// Function to receive a batch in busy-poll mode: spin on non-blocking receives and fall back to one
+// blocking receive once nothing has arrived for simConfig.busyPollIdleUs, then spin again
+static int serverPollRequests(int requestQueue, RequestMsg* reqs, int maxRequests) {
+    long idleSince = monotonicNs();
+    // the spin takes requests as they arrive, what is queued now built up while the last batch was decided
+    sampleQueueDepths();
+    while (true) {
+        int received = serverReceiveRequests(requestQueue, reqs, maxRequests, false);
+        serverStats.polls++;
+        if (received > 0) {
+            return received;
         }
-        
-        // take log message from queue and send to log file
-        serverReceiveLog(logQueue, log);
-        
+        serverStats.emptyPolls++;
+        if (monotonicNs() - idleSince >= simConfig.busyPollIdleUs * 1000L) {
+            serverStats.pollFallbacks++;
+            return serverReceiveRequests(requestQueue, reqs, maxRequests, true);
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+// function to handle train requests (acquire or release or deny access to intersection)
+// Each wake-up drains up to simConfig.batchSize requests and decides them together, then flushes the
+// responses and server log lines of the batch and drains all pending train log messages.
+void processTrainRequests(int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm, 
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting) {
+    std::vector<RequestMsg> reqs(simConfig.batchSize);
+    std::vector<char> trainDone(shm->num_trains, 0);
+    int trainsDone = 0;
+    ServerBatch batch;
+    WaiterLists waiters(shm->num_intersections); // parked ACQUIREs, only used with deferred grants
+
+    if (simConfig.busyPoll) {
+        serverPinToCpu();
+    }
+
+    // Loop until every train has sent DONE
+    while (trainsDone < shm->num_trains) {
+        int received = simConfig.busyPoll ? serverPollRequests(requestQueue, reqs.data(), simConfig.batchSize)
+                                          : serverReceiveRequests(requestQueue, reqs.data(), simConfig.batchSize, true);
+        long serviceStart = monotonicNs();
+        if (received == 0 && simConfig.transport == Transport::SOCKET) {
+            // socket clients can also wake the server by connecting, logging or going away
+            trainsDone += serverAbandonDisconnected(batch, waitQueue, waiters, trainDone, shm, inter_ptr, held, sem, mutex, waiting);
+            serverFlushBatch(responseQueue, batch);
+            continue;
+        }
+        else if (received == 0) {
+            std::cerr << "processTrainRequests [ERROR]: Failed to receive request." << std::endl;
+            continue;
+        }
+
+        trainsDone += serverDecideBatch(batch, reqs.data(), received, waitQueue, waiters, trainDone,
+                                        shm, inter_ptr, held, sem, mutex, waiting);
+
+        // a client that sent DONE and closed in the same batch is done, not abandoned
+        trainsDone += serverAbandonDisconnected(batch, waitQueue, waiters, trainDone, shm, inter_ptr, held, sem, mutex, waiting);
 
+        serverFlushBatch(responseQueue, batch);
+        serviceTimes.push_back((monotonicNs() - serviceStart) / received);
+
+        // take all pending log messages from the queue and send them to the log file
+        serverDrainLogs(logQueue);
     }
+
+    // trains log before sending DONE, pick up whatever is left
+    serverDrainLogs(logQueue);
+}
+
+// Function to print the server counters
+void printServerStats() {
+    double avgBatch = serverStats.batches ? (double)serverStats.requests / serverStats.batches : 0.0;
+
+    if (simConfig.shards > 1) {
+        std::cout << "Server stats (shard " << currentShard << " of " << simConfig.shards << "):" << std::endl;
+    } else {
+        std::cout << "Server stats:" << std::endl;
+    }
+    std::cout << "  requests:        " << serverStats.requests << std::endl;
+    std::cout << "  batch size:      " << simConfig.batchSize << " (max), "
+              << serverStats.batches << " batches, avg " << avgBatch << ", largest " << serverStats.maxBatch << std::endl;
+    std::cout << "  handoffs:        " << serverStats.handoffs << std::endl;
+    std::cout << "  responses sent:  " << serverStats.responses << std::endl;
+    std::cout << "  log lines:       " << serverStats.logLines << " in " << serverStats.logWrites << " writes" << std::endl;
+    if (shm_ptr != nullptr && shm_ptr->logSampled > 0) {
+        std::cout << "  log sampled:     " << shm_ptr->logSampled << " wait events summarized (--log-budget=" << simConfig.logBudget << ")" << std::endl;
+    }
+    if (serverStats.abandoned) {
+        std::cout << "  abandoned:       " << serverStats.abandoned << " trains exited without DONE" << std::endl;
+    }
+
+    if (!serviceTimes.empty()) {
+        std::vector<long> sorted(serviceTimes);
+        std::sort(sorted.begin(), sorted.end());
+        long total = 0;
+        for (long t : sorted) {
+            total += t;
+        }
+        std::cout << "  service time:    per request over " << sorted.size() << " batches: min " << sorted.front() / 1000.0
+                  << " us, p50 " << sorted[sorted.size() / 2] / 1000.0 << " us, p99 " << sorted[sorted.size() * 99 / 100] / 1000.0
+                  << " us, mean " << total / sorted.size() / 1000.0 << " us" << std::endl;
+    }
+    if (simConfig.busyPoll) {
+        std::cout << "  busy poll:       " << serverStats.polls << " polls, " << serverStats.emptyPolls << " empty, "
+                  << serverStats.pollFallbacks << " fell back to blocking after " << simConfig.busyPollIdleUs << " us idle" << std::endl;
+    }
+}
+
+// Function to zero the server counters before another run in the same process (daemon workers)
+void resetServerStats() {
+    serverStats.requests = 0;
+    serverStats.batches = 0;
+    serverStats.maxBatch = 0;
+    serverStats.handoffs = 0;
+    serverStats.responses = 0;
+    serverStats.logLines = 0;
+    serverStats.logWrites = 0;
+    serverStats.polls = 0;
+    serverStats.emptyPolls = 0;
+    serverStats.pollFallbacks = 0;
+    serverStats.abandoned = 0;
+    serviceTimes.clear();
+    serverResetSampledWaits();
 }
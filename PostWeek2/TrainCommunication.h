@@ -10,24 +10,70 @@ Date: 04-13-2025
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <fstream>
+#include <cstdint>
+#include <atomic>
 
 #include <semaphore.h>
 #include <pthread.h>
 #include "sync.h"
 #include "shared_Mem.h"
+#include "eventLog.h"
+#include "logLevel.h"
 
 // Message structures
+// Binary wire format: fixed size, integer IDs only. Train IDs are the dense row index
+// into the held/waiting matrices and intersection IDs are the column index, so neither
+// side copies or parses strings. Names are looked up only when a line is logged.
 struct RequestMsg {
-    long mtype;                  // Message type
-    char train_id[20];            // Train ID
-    char intersection_id[20];     // Intersection ID
+    long mtype;                  // Message type (RequestType, always > 0)
+    int32_t train_id;            // Train index
+    int16_t intersection_id;     // Intersection index (-1 when not used, e.g. DONE)
+    int16_t release_id;          // HANDOFF: intersection released before acquiring intersection_id, else -1
+    uint16_t flags;              // RequestFlag bits
+    uint32_t seq;                // per-train sequence number, echoed in the response
 };
 
 struct ResponseMsg {
-    long mtype;                  // Message type
-    int response_type;           // will be either grant, wait, or deny
-    char intersection_id[20];    
+    long mtype;                  // train index + 1 (mtype must be > 0)
+    int16_t intersection_id;     // Intersection index the response is for
+    uint8_t response_type;       // will be either grant, wait, or deny
+    uint8_t flags;               // reserved, 0
+    uint32_t seq;                // sequence number of the request being answered
+};
+
+// Responses and server log lines collected while deciding a batch of requests
+struct ServerBatch {
+    std::vector<ResponseMsg> responses;
+    std::string logLines;        // already timestamped, one write for the whole batch
+    std::string events;          // --log-format=binary: EventRecords instead of log lines
+    long logged = 0;             // lines and records queued since the last write (--log-budget)
+};
+
+// ACQUIRE parked on the server in deferred-grant mode, answered later by one GRANT
+struct ParkedRequest {
+    int32_t train_id;
+    uint32_t seq;
+};
+
+// per-intersection waiter lists, indexed by intersection index
+typedef std::vector<std::deque<ParkedRequest>> WaiterLists;
+
+// Server counters reported at the end of the run
+// Atomic so the worker, log and deadlock threads of the threaded server can all count
+struct ServerStats {
+    std::atomic<long> requests{0};     // requests received
+    std::atomic<long> batches{0};      // wake-ups that received at least one request
+    std::atomic<int> maxBatch{0};      // largest batch received
+    std::atomic<long> handoffs{0};     // HANDOFF requests (each one saved a message and an iteration)
+    std::atomic<long> responses{0};    // responses sent
+    std::atomic<long> logLines{0};     // log lines written
+    std::atomic<long> logWrites{0};    // write calls used for them
+    std::atomic<long> polls{0};        // busy poll: non-blocking receive attempts
+    std::atomic<long> emptyPolls{0};   // busy poll: attempts that found nothing
+    std::atomic<long> pollFallbacks{0};// busy poll: times the server went back to a blocking receive
+    std::atomic<int> abandoned{0};     // trains that exited or disconnected without DONE
 };
 
 // Constants per response types
@@ -35,6 +81,7 @@ namespace ResponseType {
     const int GRANT = 1;
     const int WAIT = 2;
     const int DENY = 3;
+    const int DECLINED = 4;      // lookahead ACQUIRE refused, train should ask again normally
 }
 
 // Constants per request types
@@ -42,34 +89,107 @@ namespace RequestType {
     const int ACQUIRE = 1;
     const int RELEASE = 2;
     const int DONE = 3;
+    const int HANDOFF = 4;       // release release_id and acquire intersection_id in one step
+}
+
+// Request flags
+namespace RequestFlag {
+    const uint16_t LOOKAHEAD = 1; // ACQUIRE for the next hop, sent while crossing the current one
 }
 
 // Functions
 
 std::string getTimestamp();
+std::string formatTimestamp(int time);
+std::string formatLogLine(const std::string& message);
+void writeLogLines(const std::string& lines);
 void logMessage(const std::string& message);
 
+// Binary event log (--log-format=binary)
+bool openEventLog(const char *path, const std::vector<std::string>& intersections);
+void closeEventLog();
+void writeLogEvents(const std::string& events);
+void logEventUnchecked(uint8_t type, int trainIdx, int intersectionIdx, int otherIdx);
+
+// Log an event from the server outside a batch, if its level and category are enabled
+inline void logEvent(uint8_t type, int trainIdx, int intersectionIdx, int otherIdx = -1) {
+    if (logEnabled(type)) {
+        logEventUnchecked(type, trainIdx, intersectionIdx, otherIdx);
+    }
+}
+
+// Names for logging (index -> name, name -> index)
+const char* trainName(int trainIdx);
+const char* intersectionName(int intersectionIdx);
+int findTrainIndex(const char* trainId);
+
 // Setup and Cleanup
 int setupMessageQueues(int& requestQueue, int& responseQueue, int& logQueue, int& waitQueue);
 void cleanupMessageQueues(int requestQueue, int responseQueue, int logQueue, int waitQueue);
 
 // Train side
-bool trainSendAcquireRequest(int requestQueue, int logQueue, const char* trainId, const char* intersectionId);
-bool trainSendReleaseRequest(int requestQueue, int logQueue, const char* trainId, const char* intersectionId, 
-    shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int *held);
-// **Function included in trainCommExtension** bool trainSendDoneMsg(int requestQueue, const char* trainId);
-
-int trainWaitForResponse(int responseQueue, int logQueue, const char* trainId, const char* intersectionId);
-void simulateTrainMovement(const char* trainId, const std::vector<std::string>& route, int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm,
-     Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex);
+bool trainSendRequest(int requestQueue, const RequestMsg& msg);
+bool trainSendAcquireRequest(int requestQueue, int logQueue, int trainIdx, int intersectionIdx, uint16_t flags = 0);
+bool trainSendReleaseRequestExtended(int requestQueue, int logQueue, int trainIdx, int intersectionIdx);
+bool trainSendHandoffRequest(int requestQueue, int logQueue, int trainIdx, int releaseIdx, int acquireIdx);
+// **Function included in trainCommExtension** bool trainSendDoneMsg(int requestQueue, int trainIdx);
+
+int trainWaitForResponse(int responseQueue, int logQueue, int trainIdx);
+void trainLogSampledWaits(int logQueue, int trainIdx, int intersectionIdx);
+void simulateTrainMovement(int trainIdx, const std::vector<std::string>& route, int requestQueue, int responseQueue, int logQueue, shared_mem_t *shm,
+     Intersection *inter_ptr);
+void runTrainRoute(int trainIdx, const std::vector<int>& routeIdx, int requestQueue, int responseQueue, int logQueue);
 
 // Server side
-bool serverReceiveRequest(int requestQueue, const char* trainId, const char* intersectionId, int& requestType);
-bool serverSendResponse(int responseQueue, int logQueue, const char* trainId, const char* intersectionId, int responseType);
+int serverReceiveRequests(int requestQueue, RequestMsg* reqs, int maxRequests, bool block);
+void serverQueueLog(ServerBatch& batch, const std::string& message);
+void serverQueueLog(ServerBatch& batch, const char *message, size_t length);
+void serverQueueLogAt(ServerBatch& batch, int time, const char *message, size_t length);
+void serverQueueEventUnchecked(ServerBatch& batch, uint8_t type, int trainIdx, int intersectionIdx, int otherIdx);
+
+// Add a server event to the batch, if its level and category are enabled
+inline void serverQueueEvent(ServerBatch& batch, uint8_t type, int trainIdx, int intersectionIdx, int otherIdx = -1) {
+    if (logEnabled(type)) {
+        serverQueueEventUnchecked(batch, type, trainIdx, intersectionIdx, otherIdx);
+    }
+}
+void serverQueueEventRecord(ServerBatch& batch, const char *record, size_t size);
+void serverQueueSampledWaits(ServerBatch& batch, int trainIdx, int intersectionIdx);
+void serverWriteLogs(ServerBatch& batch);
+void serverQueueResponse(ServerBatch& batch, int trainIdx, int intersectionIdx, int responseType, uint32_t seq);
+bool serverFlushBatch(int responseQueue, ServerBatch& batch);
+void serverRetryWaitQueue(ServerBatch& batch, int waitQueue, shared_mem_t *shm, Intersection *inter_ptr, 
+    int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting, bool resendWait);
+bool serverValidRequest(const RequestMsg& req, shared_mem_t *shm);
+void serverHandleAcquire(ServerBatch& batch, const RequestMsg& req, int waitQueue, WaiterLists& waiters, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+void serverHandleRelease(ServerBatch& batch, const RequestMsg& req, WaiterLists& waiters, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+int serverDecideBatch(ServerBatch& batch, RequestMsg* reqs, int received, int waitQueue, WaiterLists& waiters, std::vector<char>& trainDone,
+    shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+void grantFreedCapacity(ServerBatch& batch, int waitQueue, WaiterLists& waiters, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+int serverAbandonTrain(ServerBatch& batch, int trainIdx, int waitQueue, WaiterLists& waiters, std::vector<char>& trainDone,
+    shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+int serverAbandonDisconnected(ServerBatch& batch, int waitQueue, WaiterLists& waiters, std::vector<char>& trainDone,
+    shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
 void processTrainRequests(int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+void printServerStats();
+void resetServerStats();
 
 // Logging side
-bool sendLogMessage(int logQueue, const std::string& message); // log messages
+bool sendLogMessage(int logQueue, const char *message, size_t length); // log messages
+bool sendLogEventUnchecked(int logQueue, uint8_t type, int trainIdx, int intersectionIdx, int otherIdx, int arg);
+
+// Log a train event, if its level and category are enabled (true when it is skipped)
+inline bool sendLogEvent(int logQueue, uint8_t type, int trainIdx, int intersectionIdx, int otherIdx = -1, int arg = 0) {
+    return !logEnabled(type) || sendLogEventUnchecked(logQueue, type, trainIdx, intersectionIdx, otherIdx, arg);
+}
+
+// Train names in index order, filled in by main before the trains are forked
+extern std::vector<std::string> trainNames;
+
+extern ServerStats serverStats;
 
 // Logging file and simulated time
 extern std::ofstream logFile;
@@ -0,0 +1,275 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Event records for the binary log: building them,
+    rendering them back into the text of simulation.log, and the file header.
+    Used by the simulator and by the LogDecode tool, so it depends on nothing
+    else in the simulation.
+*/
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <initializer_list>
+#include <unistd.h>
+
+#include "eventLog.h"
+
+// ResponseType values as a train logs them (index = response type)
+static const char *responseNames[] = {"UNKNOWN", "GRANT", "WAIT", "DENY", "DECLINED"};
+
+/* makeEvent fills in a record, -1 for fields the event does not use */
+EventRecord makeEvent(int time, uint8_t type, int train, int intersection, int other, int arg)
+{
+    EventRecord event;
+    event.time = time;
+    event.type = type;
+    event.arg = arg;
+    event.train = train;
+    event.intersection = intersection;
+    event.other = other;
+    return event;
+}
+
+/* appendTextEvent stores free text as a TEXT record and as many records of raw bytes as it needs */
+void appendTextEvent(std::string& out, int time, const char *text, size_t length)
+{
+    length = std::min(length, 255 * sizeof(EventRecord));
+    int continuation = (length + sizeof(EventRecord) - 1) / sizeof(EventRecord);
+
+    EventRecord event = makeEvent(time, EventType::TEXT, -1, -1, length, continuation);
+    out.append(reinterpret_cast<const char *>(&event), sizeof(event));
+    out.append(text, length);
+    out.append(continuation * sizeof(EventRecord) - length, '\0');
+}
+
+/* join copies the parts one after the other into out, cut off at size - 1 bytes, and NUL terminates it */
+static size_t join(char *out, size_t size, std::initializer_list<const char *> parts)
+{
+    size_t used = 0;
+    for (const char *part : parts)
+    {
+        size_t length = std::min(strlen(part), size - 1 - used);
+        memcpy(out + used, part, length);
+        used += length;
+    }
+    out[used] = '\0';
+    return used;
+}
+
+/* renderEvent writes the text of one event as it reads in simulation.log, without allocating */
+size_t renderEvent(char *out, size_t size, const EventRecord& event, NameLookup train, NameLookup intersection)
+{
+    const char *t = train(event.train);
+    const char *i = intersection(event.intersection);
+    switch (event.type)
+    {
+    case EventType::TRAIN_SENT_ACQUIRE:
+        return join(out, size, {t, ": Sent ACQUIRE request for ", i, "."});
+    case EventType::TRAIN_SENT_LOOKAHEAD:
+        return join(out, size, {t, ": Sent lookahead ACQUIRE request for ", i, "."});
+    case EventType::TRAIN_SENT_RELEASE:
+        return join(out, size, {t, ": Sent RELEASE request for ", i, "."});
+    case EventType::TRAIN_SENT_HANDOFF:
+        return join(out, size, {t, ": Sent HANDOFF request, releasing ", intersection(event.other), " for ", i, "."});
+    case EventType::TRAIN_RECEIVED:
+        return join(out, size, {t, ": Received ", responseNames[event.arg <= 4 ? event.arg : 0], " for ", i, "."});
+    case EventType::TRAIN_WAITING:
+        return join(out, size, {t, ": Waiting for ", i, "..."});
+    case EventType::TRAIN_DENIED:
+        return join(out, size, {t, ": DENIED access to ", i, "."});
+    case EventType::TRAIN_ACQUIRED:
+        return join(out, size, {t, ": Acquired ", i, ". Proceeding..."});
+    case EventType::TRAIN_COMPLETED:
+        return join(out, size, {t, ": Completed route."});
+    case EventType::SERVER_GRANTED:
+        return join(out, size, {"SERVER: GRANTED ", i, " to ", t, "."});
+    case EventType::SERVER_QUEUED:
+        return join(out, size, {"SERVER: ", i, " is busy. ", t, " added to wait queue."});
+    case EventType::SERVER_DECLINED:
+        return join(out, size, {"SERVER: DECLINED lookahead on ", i, " for ", t, " to avoid a deadlock."});
+    case EventType::SERVER_PARKED:
+        return join(out, size, {"SERVER: ", i, " is busy. ", t, " parked until it is released."});
+    case EventType::SERVER_RELEASED:
+        return join(out, size, {"SERVER: ", t, " released ", i, "."});
+    case EventType::SERVER_HANDED_OFF:
+        return join(out, size, {"SERVER: ", t, " handed off ", intersection(event.other), " for ", i, "."});
+    case EventType::SERVER_TRAIN_DONE:
+        return join(out, size, {"SERVER: ", t, " completed its route."});
+    case EventType::SERVER_ABANDONED:
+        return join(out, size, {"SERVER: ", t, " exited without completing its route."});
+    case EventType::DEADLOCK_PREEMPTED:
+        return join(out, size, {t, " released ", i, " forcibly to resolve deadlock."});
+    case EventType::SERVER_BATCH:
+        return join(out, size, {"SERVER: batch"});
+    case EventType::WAIT_SUMMARY:
+    {
+        char count[8];
+        snprintf(count, sizeof(count), "%d", event.other);
+        const char *times = event.other == 1 ? " time for " : " times for ";
+        if (event.arg == EventType::TRAIN_WAITING)
+        {
+            return join(out, size, {t, ": Waited ", count, times, i, " (log sampled)."});
+        }
+        return join(out, size, {"SERVER: ", t, " waited ", count, times, i, " (log sampled)."});
+    }
+    default:
+        char number[8];
+        snprintf(number, sizeof(number), "%d", event.type);
+        return join(out, size, {"UNKNOWN EVENT ", number});
+    }
+}
+
+/* putDigits writes value as at least two decimal digits, returns how many it wrote */
+static size_t putDigits(char *out, int value)
+{
+    char digits[12];
+    size_t count = 0;
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0 || count < 2);
+    for (size_t d = 0; d < count; d++)
+    {
+        out[d] = digits[count - 1 - d];
+    }
+    return count;
+}
+
+/* formatLogStamp writes "[hh:mm:ss] " with digit arithmetic instead of a stream */
+size_t formatLogStamp(char *out, int time)
+{
+    if (time < 0)
+    {
+        time = 0;
+    }
+    size_t used = 0;
+    out[used++] = '[';
+    used += putDigits(out + used, time / 3600);
+    out[used++] = ':';
+    used += putDigits(out + used, (time % 3600) / 60);
+    out[used++] = ':';
+    used += putDigits(out + used, time % 60);
+    out[used++] = ']';
+    out[used++] = ' ';
+    return used;
+}
+
+// Last stamp this thread formatted. The simulated time only moves once per response, so most
+// lines of a batch share it; each thread keeps its own so the cache needs no lock.
+struct StampCache {
+    int time = -1;
+    size_t length = 0;
+    char stamp[24];
+};
+static thread_local StampCache stampCache;
+
+/*
+* appendLogLine appends one timestamped line, the only allocation is lines growing its capacity.
+* The stamp is formatted again only when the time differs from the previous line's.
+*/
+void appendLogLine(std::string& lines, int time, const char *text, size_t length)
+{
+    if (time != stampCache.time)
+    {
+        stampCache.length = formatLogStamp(stampCache.stamp, time);
+        stampCache.time = time;
+    }
+    lines.append(stampCache.stamp, stampCache.length);
+    lines.append(text, length);
+    lines += '\n';
+}
+
+/*
+* renderEventLines renders every record in data as "[hh:mm:ss] text" lines. A TEXT record's text
+* is in the records after it. SERVER_BATCH markers give no line. A record cut off at the end (a run that was killed) is skipped.
+*/
+int renderEventLines(const char *data, size_t size, NameLookup train, NameLookup intersection, std::string& lines)
+{
+    int events = 0;
+    size_t offset = 0;
+    char text[EVENT_TEXT_MAX];
+    while (offset + sizeof(EventRecord) <= size)
+    {
+        EventRecord event;
+        memcpy(&event, data + offset, sizeof(event));
+        offset += sizeof(event);
+
+        if (event.type == EventType::TEXT)
+        {
+            size_t bytes = event.arg * sizeof(EventRecord);
+            if (offset + bytes > size)
+            {
+                break;
+            }
+            appendLogLine(lines, event.time, data + offset, std::min<size_t>(event.other < 0 ? 0 : event.other, bytes));
+            offset += bytes;
+        }
+        else if (event.type == EventType::SERVER_BATCH)
+        {
+            continue; // only there for traces, simulation.log has no line for it
+        }
+        else
+        {
+            appendLogLine(lines, event.time, text, renderEvent(text, sizeof(text), event, train, intersection));
+        }
+        events++;
+    }
+    return events;
+}
+
+/* writeEventLogHeader writes the header and both name tables in one write */
+long writeEventLogHeader(int fd, const std::vector<std::string>& trains, const std::vector<std::string>& intersections)
+{
+    EventLogHeader header;
+    memcpy(header.magic, "RLEV", 4);
+    header.version = 1;
+    header.recordSize = sizeof(EventRecord);
+    header.numTrains = trains.size();
+    header.numIntersections = intersections.size();
+
+    std::string out(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const std::string& name : trains)
+    {
+        out.append(name.c_str(), name.size() + 1);
+    }
+    for (const std::string& name : intersections)
+    {
+        out.append(name.c_str(), name.size() + 1);
+    }
+    if (write(fd, out.data(), out.size()) != (ssize_t)out.size())
+    {
+        return -1;
+    }
+    return out.size();
+}
+
+/* readEventLogHeader checks the header and reads the name tables */
+long readEventLogHeader(const std::string& data, std::vector<std::string>& trains, std::vector<std::string>& intersections)
+{
+    EventLogHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return -1;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, "RLEV", 4) != 0 || header.version != 1 || header.recordSize != sizeof(EventRecord))
+    {
+        return -1;
+    }
+
+    size_t offset = sizeof(header);
+    for (int n = 0; n < header.numTrains + header.numIntersections; n++)
+    {
+        size_t end = data.find('\0', offset);
+        if (end == std::string::npos)
+        {
+            return -1;
+        }
+        (n < header.numTrains ? trains : intersections).push_back(data.substr(offset, end - offset));
+        offset = end + 1;
+    }
+    return offset;
+}
@@ -0,0 +1,101 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Binary event log. Every log line the simulation writes is
+    one of a fixed set of events about a train and an intersection, so instead of
+    formatting a string the producer fills in a 12-byte EventRecord. With
+    --log-format=binary the server appends the records to data/simulation.bin
+    after a header holding the train and intersection names; the LogDecode tool
+    (logDecode.cpp) renders them into the same lines as data/simulation.log.
+    Anything that is not one of the events (deadlock reports, socket client lines)
+    is stored as a TEXT event followed by its bytes.
+*/
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Event types, the comment is the rendered text (T train, I intersection, O other intersection)
+namespace EventType {
+    const uint8_t TEXT = 0;                 // arg continuation records follow, other = text length
+    const uint8_t TRAIN_SENT_ACQUIRE = 1;   // "T: Sent ACQUIRE request for I."
+    const uint8_t TRAIN_SENT_LOOKAHEAD = 2; // "T: Sent lookahead ACQUIRE request for I."
+    const uint8_t TRAIN_SENT_RELEASE = 3;   // "T: Sent RELEASE request for I."
+    const uint8_t TRAIN_SENT_HANDOFF = 4;   // "T: Sent HANDOFF request, releasing O for I."
+    const uint8_t TRAIN_RECEIVED = 5;       // "T: Received <arg response> for I."
+    const uint8_t TRAIN_WAITING = 6;        // "T: Waiting for I..."
+    const uint8_t TRAIN_DENIED = 7;         // "T: DENIED access to I."
+    const uint8_t TRAIN_ACQUIRED = 8;       // "T: Acquired I. Proceeding..."
+    const uint8_t TRAIN_COMPLETED = 9;      // "T: Completed route."
+    const uint8_t SERVER_GRANTED = 10;      // "SERVER: GRANTED I to T."
+    const uint8_t SERVER_QUEUED = 11;       // "SERVER: I is busy. T added to wait queue."
+    const uint8_t SERVER_DECLINED = 12;     // "SERVER: DECLINED lookahead on I for T to avoid a deadlock."
+    const uint8_t SERVER_PARKED = 13;       // "SERVER: I is busy. T parked until it is released."
+    const uint8_t SERVER_RELEASED = 14;     // "SERVER: T released I."
+    const uint8_t SERVER_HANDED_OFF = 15;   // "SERVER: T handed off O for I."
+    const uint8_t SERVER_TRAIN_DONE = 16;   // "SERVER: T completed its route."
+    const uint8_t SERVER_ABANDONED = 17;    // "SERVER: T exited without completing its route."
+    const uint8_t DEADLOCK_PREEMPTED = 18;  // "T released I forcibly to resolve deadlock."
+    const uint8_t SERVER_BATCH = 19;        // no line: a server batch of other records follows, arg = responses
+    const uint8_t WAIT_SUMMARY = 20;        // sampled waits, arg = TRAIN_WAITING: "T: Waited N times for I (log sampled)."
+                                            // arg = SERVER_QUEUED/PARKED: "SERVER: T waited N times for I (log sampled)."
+    const uint8_t COUNT = 21;
+}
+
+struct EventRecord {
+    int32_t time;           // simulated time when the event happened
+    uint8_t type;           // EventType
+    uint8_t arg;            // TRAIN_RECEIVED: ResponseType, TEXT: continuation records
+    int16_t train;          // train index, -1 if none
+    int16_t intersection;   // intersection index, -1 if none
+    int16_t other;          // TRAIN_SENT_HANDOFF/SERVER_HANDED_OFF: released intersection, TEXT: length,
+                            // SERVER_BATCH: records in the batch, WAIT_SUMMARY: number of waits
+};
+
+// data/simulation.bin starts with this header, then the train names and the intersection names
+// (each NUL terminated, in index order), then EventRecords until the end of the file
+struct EventLogHeader {
+    char magic[4];          // "RLEV"
+    uint16_t version;
+    uint16_t recordSize;    // sizeof(EventRecord)
+    int32_t numTrains;
+    int32_t numIntersections;
+};
+
+// Longest rendered event text; rendering into a buffer this size never cuts an event short
+const int EVENT_TEXT_MAX = 192;
+
+// Length of the "[hh:mm:ss] " stamp for times under 100 hours, a stamp buffer needs 24 bytes
+const int LOG_STAMP_LENGTH = 11;
+
+// Build a record for the simulated time given
+EventRecord makeEvent(int time, uint8_t type, int train, int intersection, int other = -1, int arg = 0);
+
+// Append a TEXT event and the records holding its bytes to out
+void appendTextEvent(std::string& out, int time, const char *text, size_t length);
+
+// Name of a train or intersection index, out-of-range indices give a placeholder name
+typedef const char *(*NameLookup)(int index);
+
+// Write the text of an event without timestamp, as it appears in simulation.log, into out
+// (size bytes, NUL terminated, cut off if it does not fit), returns its length
+size_t renderEvent(char *out, size_t size, const EventRecord& event, NameLookup train, NameLookup intersection);
+
+// Write "[hh:mm:ss] " for a simulated time into out (at least 24 bytes), returns its length
+size_t formatLogStamp(char *out, int time);
+
+// Append "[hh:mm:ss] text\n" to lines without building any temporary string
+void appendLogLine(std::string& lines, int time, const char *text, size_t length);
+
+// Render a buffer of records (with TEXT continuations) as timestamped log lines, returns the event count
+int renderEventLines(const char *data, size_t size, NameLookup train, NameLookup intersection, std::string& lines);
+
+// Write the header with the names, returns the number of bytes written or -1
+long writeEventLogHeader(int fd, const std::vector<std::string>& trains, const std::vector<std::string>& intersections);
+
+// Read the header and names from the start of a file's contents, returns the offset of the first record or -1
+long readEventLogHeader(const std::string& data, std::vector<std::string>& trains, std::vector<std::string>& intersections);
+
+#endif
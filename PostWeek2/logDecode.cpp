@@ -0,0 +1,76 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: LogDecode renders a binary event log written with
+    --log-format=binary back into the lines of simulation.log, or with --trace
+    into a Chrome trace for Perfetto.
+    Usage: ./LogDecode [--trace] [data/simulation.bin] > data/simulation.log
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "eventLog.h"
+#include "traceExport.h"
+
+// name tables from the file header
+static std::vector<std::string> trainTable;
+static std::vector<std::string> intersectionTable;
+
+/* trainLookup gives the train name for an index in the file */
+static const char *trainLookup(int index)
+{
+    if (index < 0 || index >= (int)trainTable.size())
+    {
+        return "UnknownTrain";
+    }
+    return trainTable[index].c_str();
+}
+
+/* intersectionLookup gives the intersection name for an index in the file */
+static const char *intersectionLookup(int index)
+{
+    if (index < 0 || index >= (int)intersectionTable.size())
+    {
+        return "UnknownIntersection";
+    }
+    return intersectionTable[index].c_str();
+}
+
+int main(int argc, char *argv[])
+{
+    bool trace = argc > 1 && strcmp(argv[1], "--trace") == 0;
+    int pathArg = trace ? 2 : 1;
+    const char *path = argc > pathArg ? argv[pathArg] : "data/simulation.bin";
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "LogDecode [ERROR]: Failed to open " << path << std::endl;
+        return 1;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string data = contents.str();
+
+    long offset = readEventLogHeader(data, trainTable, intersectionTable);
+    if (offset == -1)
+    {
+        std::cerr << "LogDecode [ERROR]: " << path << " is not an event log of this version" << std::endl;
+        return 1;
+    }
+
+    if (trace)
+    {
+        writeChromeTrace(data.data() + offset, data.size() - offset, trainTable.size(), intersectionTable.size(),
+            trainLookup, intersectionLookup, std::cout);
+        return 0;
+    }
+
+    std::string lines;
+    renderEventLines(data.data() + offset, data.size() - offset, trainLookup, intersectionLookup, lines);
+    std::cout << lines;
+    return 0;
+}
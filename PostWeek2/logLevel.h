@@ -0,0 +1,86 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Log level and category of every event, and the checks
+    callers make before building a log message. An event is logged when its level
+    is compiled in (LOG_COMPILED_LEVEL), at most --log-level and its category is in
+    --log-categories. The checks are inline, so with the event type known at the
+    call site a build with -DLOG_COMPILED_LEVEL=1 drops the DEBUG calls entirely
+    and a disabled event costs one compare at run time, before anything is formatted.
+*/
+
+#ifndef LOG_LEVEL_H
+#define LOG_LEVEL_H
+
+#include <cstdint>
+
+#include "eventLog.h"
+#include "SimConfig.h"
+
+// Highest level kept in the build, lower it with -DLOG_COMPILED_LEVEL=1 (INFO) or 0 (NONE)
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 2
+#endif
+
+// level of each EventType (TEXT events give theirs at the call site)
+constexpr int eventLevel[EventType::COUNT] = {
+    LogLevel::INFO,     // TEXT
+    LogLevel::DEBUG,    // TRAIN_SENT_ACQUIRE
+    LogLevel::DEBUG,    // TRAIN_SENT_LOOKAHEAD
+    LogLevel::DEBUG,    // TRAIN_SENT_RELEASE
+    LogLevel::DEBUG,    // TRAIN_SENT_HANDOFF
+    LogLevel::DEBUG,    // TRAIN_RECEIVED
+    LogLevel::DEBUG,    // TRAIN_WAITING
+    LogLevel::INFO,     // TRAIN_DENIED
+    LogLevel::INFO,     // TRAIN_ACQUIRED
+    LogLevel::INFO,     // TRAIN_COMPLETED
+    LogLevel::INFO,     // SERVER_GRANTED
+    LogLevel::DEBUG,    // SERVER_QUEUED
+    LogLevel::INFO,     // SERVER_DECLINED
+    LogLevel::DEBUG,    // SERVER_PARKED
+    LogLevel::INFO,     // SERVER_RELEASED
+    LogLevel::INFO,     // SERVER_HANDED_OFF
+    LogLevel::INFO,     // SERVER_TRAIN_DONE
+    LogLevel::INFO,     // SERVER_ABANDONED
+    LogLevel::INFO,     // DEADLOCK_PREEMPTED
+    LogLevel::INFO,     // SERVER_BATCH
+    LogLevel::DEBUG,    // WAIT_SUMMARY
+};
+
+// category of each EventType
+constexpr unsigned eventCategory[EventType::COUNT] = {
+    LogCategory::SERVER,    // TEXT
+    LogCategory::PROTOCOL,  // TRAIN_SENT_ACQUIRE
+    LogCategory::PROTOCOL,  // TRAIN_SENT_LOOKAHEAD
+    LogCategory::PROTOCOL,  // TRAIN_SENT_RELEASE
+    LogCategory::PROTOCOL,  // TRAIN_SENT_HANDOFF
+    LogCategory::PROTOCOL,  // TRAIN_RECEIVED
+    LogCategory::WAIT,      // TRAIN_WAITING
+    LogCategory::GRANT,     // TRAIN_DENIED
+    LogCategory::GRANT,     // TRAIN_ACQUIRED
+    LogCategory::SERVER,    // TRAIN_COMPLETED
+    LogCategory::GRANT,     // SERVER_GRANTED
+    LogCategory::WAIT,      // SERVER_QUEUED
+    LogCategory::WAIT,      // SERVER_DECLINED
+    LogCategory::WAIT,      // SERVER_PARKED
+    LogCategory::GRANT,     // SERVER_RELEASED
+    LogCategory::GRANT,     // SERVER_HANDED_OFF
+    LogCategory::SERVER,    // SERVER_TRAIN_DONE
+    LogCategory::SERVER,    // SERVER_ABANDONED
+    LogCategory::DEADLOCK,  // DEADLOCK_PREEMPTED
+    LogCategory::SERVER,    // SERVER_BATCH
+    LogCategory::WAIT,      // WAIT_SUMMARY
+};
+
+// true if a message of this category and level is logged
+inline bool logEnabled(unsigned category, int level)
+{
+    return level <= LOG_COMPILED_LEVEL && level <= simConfig.logLevel && (category & simConfig.logCategories) != 0;
+}
+
+// true if an event of this type is logged
+inline bool logEnabled(uint8_t type)
+{
+    return type < EventType::COUNT && logEnabled(eventCategory[type], eventLevel[type]);
+}
+
+#endif
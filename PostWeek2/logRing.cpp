@@ -0,0 +1,254 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Per-train single-producer log rings. The train is the
+    only writer of its head and the server the only writer of its tail, so a
+    release store on one side and an acquire load on the other is all the
+    synchronization a record needs.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+
+#include "logRing.h"
+#include "TrainCommunication.h"
+#include "SimConfig.h"
+#include "serverEventLoop.h"
+#include "serverShards.h"
+
+extern shared_mem_t *shm_ptr;
+
+static LogRingHeader *logRings = nullptr;
+
+// ring this process writes to, -1 in the server
+static int ringTrain = -1;
+
+// messages that found the ring full, for the sample policy (per process)
+static long ringOverflowSeen = 0;
+
+/* ringIndex returns the head/tail pair of a train */
+static LogRingIndex *ringIndex(int trainIdx)
+{
+    LogRingIndex *indexes = reinterpret_cast<LogRingIndex *>(
+        reinterpret_cast<char *>(logRings) + ((sizeof(LogRingHeader) + 63) / 64) * 64);
+    return &indexes[trainIdx];
+}
+
+/* ringRecord returns slot i of a train's ring */
+static LogRecord *ringRecord(int trainIdx, uint32_t i)
+{
+    LogRecord *records = reinterpret_cast<LogRecord *>(ringIndex(logRings->num_trains));
+    return &records[(size_t)trainIdx * logRings->slots + i % logRings->slots];
+}
+
+/*
+* logRingSetup maps the header, a head/tail pair per train and slots records per train,
+* shared with the trains forked afterwards
+* output: false if the mapping failed
+*/
+bool logRingSetup(int num_trains, int slots)
+{
+    size_t length = ((sizeof(LogRingHeader) + 63) / 64) * 64 + num_trains * sizeof(LogRingIndex)
+        + (size_t)num_trains * slots * sizeof(LogRecord);
+    void *ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        std::cerr << "logRingSetup [ERROR]: " << strerror(errno) << std::endl;
+        return false;
+    }
+    // anonymous mappings start zeroed: every ring is empty
+    logRings = static_cast<LogRingHeader *>(ptr);
+    logRings->num_trains = num_trains;
+    logRings->slots = slots;
+    logRings->nextSeq = 0;
+    logRings->length = length;
+    return true;
+}
+
+/* logRingClose unmaps the rings */
+void logRingClose()
+{
+    if (logRings == nullptr)
+    {
+        return;
+    }
+    munmap(logRings, logRings->length);
+    logRings = nullptr;
+    ringTrain = -1;
+}
+
+/* logRingAttach makes this process the producer of trainIdx's ring */
+void logRingAttach(int trainIdx)
+{
+    if (logRings != nullptr && trainIdx >= 0 && trainIdx < logRings->num_trains)
+    {
+        ringTrain = trainIdx;
+    }
+}
+
+/* logRingsActive reports whether the trains log through the rings */
+bool logRingsActive()
+{
+    return logRings != nullptr;
+}
+
+/*
+* ringPush copies size bytes into as many records as they need and publishes them together.
+* While the ring is full, drop drops the message and sample keeps one in simConfig.logSampleEvery;
+* what is kept (and everything with block or spill) goes over the log queue instead, because the
+* blocking server loop only drains logs after a request and a train waiting here sends none. The
+* server drains the rings before the queue, so the train's messages stay in order.
+* output: false if the caller should send the message over the log queue
+*/
+static bool ringPush(const char *data, size_t size, uint16_t flags)
+{
+    if (ringTrain == -1)
+    {
+        return false;
+    }
+    LogRingIndex *index = ringIndex(ringTrain);
+    ipc_counters_t *counters = &shm_ptr->logSend;
+    uint32_t needed = std::max<size_t>(1, (size + LOG_RECORD_TEXT - 1) / LOG_RECORD_TEXT);
+    if (needed > (uint32_t)logRings->slots)
+    {
+        needed = logRings->slots; // longer than the whole ring, keep what fits
+    }
+
+    uint32_t head = index->head;
+    if (head - __atomic_load_n(&index->tail, __ATOMIC_ACQUIRE) + needed > (uint32_t)logRings->slots)
+    {
+        __atomic_fetch_add(&counters->fullEvents, 1, __ATOMIC_RELAXED);
+        bool keep = simConfig.logOverflow == LogOverflow::BLOCK || simConfig.logOverflow == LogOverflow::SPILL
+            || (simConfig.logOverflow == LogOverflow::SAMPLE && ringOverflowSeen++ % simConfig.logSampleEvery == 0);
+        if (keep)
+        {
+            return false;
+        }
+        __atomic_fetch_add(&counters->sends, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&counters->dropped, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    __atomic_fetch_add(&counters->sends, 1, __ATOMIC_RELAXED);
+    uint32_t seq = __atomic_fetch_add(&logRings->nextSeq, 1, __ATOMIC_RELAXED);
+    int time = __atomic_load_n(&shm_ptr->simulatedTime, __ATOMIC_RELAXED);
+    size_t offset = 0;
+    for (uint32_t r = 0; r < needed; r++)
+    {
+        LogRecord *record = ringRecord(ringTrain, head + r);
+        size_t length = std::min<size_t>(LOG_RECORD_TEXT, size - offset);
+        record->seq = seq;
+        record->time = time;
+        record->length = length;
+        record->flags = flags | (r + 1 < needed ? LOG_RECORD_MORE : 0);
+        memcpy(record->text, data + offset, length);
+        offset += length;
+    }
+    __atomic_store_n(&index->head, head + needed, __ATOMIC_RELEASE);
+    ringDoorbell(logDoorbell);
+    return true;
+}
+
+/* logRingPush logs a text message through this train's ring */
+bool logRingPush(const char *message, size_t length)
+{
+    return ringPush(message, length, 0);
+}
+
+/* logRingPushEvent logs a binary event record through this train's ring, it fits one record */
+bool logRingPushEvent(const EventRecord& event)
+{
+    return ringPush(reinterpret_cast<const char *>(&event), sizeof(event), LOG_RECORD_EVENT);
+}
+
+/*
+* logRingDrain takes every published message from every ring, puts them back in the order they
+* were logged (each ring is in order already, seq orders them across trains) and formats them
+* with the simulated time they were logged at; event records are queued as they are. Messages are
+* formatted straight from the ring records and the tails only move afterwards, so nothing is
+* copied or allocated once the pending list has grown. Only shard 0 drains, the rings have one
+* consumer.
+*/
+int logRingDrain(ServerBatch& batch)
+{
+    if (logRings == nullptr || currentShard != 0)
+    {
+        return 0;
+    }
+
+    struct Pending {
+        uint32_t seq;
+        int train;
+        uint32_t first;     // ring position of the first record
+        uint32_t records;
+    };
+    static std::vector<Pending> pending;
+    static std::vector<uint32_t> heads;
+    pending.clear();
+    heads.resize(logRings->num_trains);
+
+    for (int t = 0; t < logRings->num_trains; t++)
+    {
+        LogRingIndex *index = ringIndex(t);
+        uint32_t head = __atomic_load_n(&index->head, __ATOMIC_ACQUIRE);
+        uint32_t tail = index->tail;
+        heads[t] = head;
+        while (tail != head)
+        {
+            Pending message{ringRecord(t, tail)->seq, t, tail, 0};
+            while (true)
+            {
+                LogRecord *record = ringRecord(t, tail++);
+                message.records++;
+                if (!(record->flags & LOG_RECORD_MORE) || tail == head)
+                {
+                    break;
+                }
+            }
+            pending.push_back(message);
+        }
+    }
+
+    // sequence numbers only wrap after 4 billion messages, compare the distance to stay correct then
+    std::sort(pending.begin(), pending.end(), [](const Pending &a, const Pending &b) {
+        return (int32_t)(a.seq - b.seq) < 0;
+    });
+    for (const Pending &message : pending)
+    {
+        LogRecord *record = ringRecord(message.train, message.first);
+        if (record->flags & LOG_RECORD_EVENT)
+        {
+            serverQueueEventRecord(batch, record->text, record->length);
+        }
+        else if (message.records == 1)
+        {
+            serverQueueLogAt(batch, record->time, record->text, record->length);
+        }
+        else
+        {
+            // a long message is split over consecutive slots that may wrap, join it on the stack
+            // (anything past 8 records is cut off, rendered events take one or two)
+            char text[LOG_RECORD_TEXT * 8];
+            size_t length = 0;
+            for (uint32_t r = 0; r < message.records; r++)
+            {
+                LogRecord *part = ringRecord(message.train, message.first + r);
+                size_t take = std::min<size_t>(part->length, sizeof(text) - length);
+                memcpy(text + length, part->text, take);
+                length += take;
+            }
+            serverQueueLogAt(batch, record->time, text, length);
+        }
+    }
+
+    // hand the slots back to the trains only now that nothing reads them any more
+    for (int t = 0; t < logRings->num_trains; t++)
+    {
+        __atomic_store_n(&ringIndex(t)->tail, heads[t], __ATOMIC_RELEASE);
+    }
+    return pending.size();
+}
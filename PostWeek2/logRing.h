@@ -0,0 +1,73 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Per-train log rings in a shared mapping. Each forked train
+    owns one single-producer ring of fixed-size log records; it copies a message in
+    and publishes it with one atomic store, with no system call and no 100-byte
+    limit (long messages take several consecutive records). The server takes every
+    published record of every ring in one pass when it drains logs and merges them
+    back into the order they were logged in.
+*/
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "eventLog.h"
+
+struct ServerBatch;
+
+// text bytes per record, a record is 128 bytes
+const int LOG_RECORD_TEXT = 116;
+
+// LogRecord flags
+const uint16_t LOG_RECORD_MORE = 1;    // the message continues in the next record
+const uint16_t LOG_RECORD_EVENT = 2;   // text holds an EventRecord (--log-format=binary)
+
+struct LogRecord {
+    uint32_t seq;                  // global log order across trains (first record of a message)
+    int32_t time;                  // simulated time when the train logged it
+    uint16_t length;               // text bytes used in this record
+    uint16_t flags;                // LOG_RECORD_MORE, LOG_RECORD_EVENT
+    char text[LOG_RECORD_TEXT];
+};
+
+// read/write positions of one train's ring, producer and consumer on separate cache lines
+struct LogRingIndex {
+    alignas(64) uint32_t head;     // records published by the train
+    alignas(64) uint32_t tail;     // records taken by the server
+};
+
+struct LogRingHeader {
+    int num_trains;
+    int slots;                     // records per train
+    uint32_t nextSeq;              // next sequence number, taken with an atomic add
+    size_t length;                 // size of the whole mapping
+};
+
+// Create a ring of slots records for every train, call before forking the trains
+bool logRingSetup(int num_trains, int slots);
+
+// Unmap the rings
+void logRingClose();
+
+// Train side: the ring this process writes to, called when the train starts its route
+void logRingAttach(int trainIdx);
+
+// Train side: false if the caller should use the log queue (no ring in this process, or the ring
+// is full and simConfig.logOverflow keeps the message), true if it was logged or dropped
+bool logRingPush(const char *message, size_t length);
+
+// Train side: same as logRingPush for one binary event record
+bool logRingPushEvent(const EventRecord& event);
+
+// Server side: queue every published record on the batch as a log line or event, in log order,
+// returns the message count
+int logRingDrain(ServerBatch& batch);
+
+// true when the trains log through the rings instead of the log queue
+bool logRingsActive();
+
+#endif
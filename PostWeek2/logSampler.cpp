@@ -0,0 +1,173 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Window accounting and wait counters for --log-budget.
+    The window lives in shared memory so every train and the server (all shards
+    and worker threads) see the same state; the counters are per process.
+*/
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <time.h>
+
+#include "logSampler.h"
+#include "eventLog.h"
+#include "shared_Mem.h"
+#include "SimConfig.h"
+#include "TrainCommunication.h"
+
+extern shared_mem_t *shm_ptr;
+
+// waits this train process counted, a train waits for one intersection at a time
+static int trainWaits = 0;
+static int trainWaitIntersection = -1;
+
+// waits the server counted, shared by its worker threads
+static std::mutex serverWaitsMutex;
+static std::vector<SampledWait> serverWaits;
+static std::atomic<int> serverWaitsPending{0};   // entries in serverWaits, checked before locking
+
+/* monotonicNs gives CLOCK_MONOTONIC in nanoseconds, the same clock in every process */
+static long monotonicNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* countSampled adds a summarized event to the window (so sampling stays on while the demand is high) and to the total */
+static void countSampled()
+{
+    __atomic_add_fetch(&shm_ptr->logWindowLines, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm_ptr->logSampled, 1, __ATOMIC_RELAXED);
+}
+
+bool logSampleCandidate(uint8_t type, int arg)
+{
+    return type == EventType::TRAIN_WAITING || type == EventType::SERVER_QUEUED || type == EventType::SERVER_PARKED
+        || (type == EventType::TRAIN_RECEIVED && arg == ResponseType::WAIT);
+}
+
+bool logSamplingActive()
+{
+    // socket clients have no shared memory and always log
+    return shm_ptr != nullptr && __atomic_load_n(&shm_ptr->logSampling, __ATOMIC_RELAXED) != 0;
+}
+
+/*
+* logSamplerAdd is called by the server for every batch it writes. The thread that wins the
+* exchange of the window start closes the window and compares its lines with the budget
+* scaled to the window's real length (a quiet server may close one after seconds).
+*/
+int logSamplerAdd(long lines)
+{
+    if (simConfig.logBudget <= 0 || shm_ptr == nullptr)
+    {
+        return 0;
+    }
+    __atomic_add_fetch(&shm_ptr->logWindowLines, lines, __ATOMIC_RELAXED);
+
+    long now = monotonicNs();
+    long start = __atomic_load_n(&shm_ptr->logWindowStart, __ATOMIC_RELAXED);
+    if (now - start < LOG_WINDOW_NS ||
+        !__atomic_compare_exchange_n(&shm_ptr->logWindowStart, &start, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+    long windowLines = __atomic_exchange_n(&shm_ptr->logWindowLines, 0, __ATOMIC_RELAXED);
+    if (start == 0)
+    {
+        return 0;   // first window of the run
+    }
+
+    double budget = simConfig.logBudget * ((now - start) / 1e9);
+    bool sampling = logSamplingActive();
+    if (!sampling)
+    {
+        if (windowLines <= budget)
+        {
+            return 0;
+        }
+        __atomic_store_n(&shm_ptr->logQuietNs, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&shm_ptr->logSampling, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    long quiet = windowLines < budget / 2 ? __atomic_load_n(&shm_ptr->logQuietNs, __ATOMIC_RELAXED) + (now - start) : 0;
+    __atomic_store_n(&shm_ptr->logQuietNs, quiet, __ATOMIC_RELAXED);
+    if (quiet < LOG_QUIET_NS)
+    {
+        return 0;
+    }
+    __atomic_store_n(&shm_ptr->logSampling, 0, __ATOMIC_RELAXED);
+    return -1;
+}
+
+void trainSampleWait(uint8_t type, int intersectionIdx)
+{
+    countSampled();
+    // every wait is one Received WAIT and one Waiting for, the summary counts the waits
+    if (type != EventType::TRAIN_WAITING)
+    {
+        return;
+    }
+    if (intersectionIdx != trainWaitIntersection)
+    {
+        trainWaits = 0;
+        trainWaitIntersection = intersectionIdx;
+    }
+    trainWaits++;
+}
+
+int trainTakeSampledWaits(int intersectionIdx)
+{
+    int waits = intersectionIdx == trainWaitIntersection ? trainWaits : 0;
+    trainWaits = 0;
+    trainWaitIntersection = -1;
+    return waits;
+}
+
+void serverSampleWait(uint8_t type, int trainIdx, int intersectionIdx)
+{
+    countSampled();
+    std::lock_guard<std::mutex> lock(serverWaitsMutex);
+    for (SampledWait& wait : serverWaits)
+    {
+        if (wait.train == trainIdx && wait.intersection == intersectionIdx)
+        {
+            wait.count++;
+            return;
+        }
+    }
+    serverWaits.push_back(SampledWait{trainIdx, intersectionIdx, type, 1});
+    serverWaitsPending++;
+}
+
+bool serverTakeSampledWait(int trainIdx, int intersectionIdx, SampledWait& wait)
+{
+    // grants and exits call this for every train, nothing to do unless the log was sampled
+    if (serverWaitsPending.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(serverWaitsMutex);
+    for (size_t w = 0; w < serverWaits.size(); w++)
+    {
+        if (serverWaits[w].train == trainIdx && (intersectionIdx == -1 || serverWaits[w].intersection == intersectionIdx))
+        {
+            wait = serverWaits[w];
+            serverWaits[w] = serverWaits.back();
+            serverWaits.pop_back();
+            serverWaitsPending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void serverResetSampledWaits()
+{
+    std::lock_guard<std::mutex> lock(serverWaitsMutex);
+    serverWaits.clear();
+    serverWaitsPending = 0;
+}
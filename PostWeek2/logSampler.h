@@ -0,0 +1,56 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Adaptive sampling of the wait events (--log-budget).
+    The server adds up the log lines of every 100 ms window in shared memory.
+    Once a window goes over the budget it turns sampling on. While it is on,
+    trains and the server count their wait events (Received WAIT, Waiting for,
+    added to wait queue, parked) instead of logging each one, and log one summary
+    per wait when it ends, e.g. "Train7: Waited 43 times for IntersectionB". Sampling
+    stops once the log has stayed under half the budget for a second, so a
+    bursty load does not switch it on and off every window. Grants, releases
+    and deadlock events are always logged.
+*/
+
+#ifndef LOG_SAMPLER_H
+#define LOG_SAMPLER_H
+
+#include <cstdint>
+
+// length of a --log-budget window, and how long the log must stay under half the budget before sampling stops
+const long LOG_WINDOW_NS = 100000000;
+const long LOG_QUIET_NS = 1000000000;
+
+// Waits of one train for one intersection counted by the server while sampling
+struct SampledWait {
+    int train;
+    int intersection;
+    uint8_t type;       // SERVER_QUEUED or SERVER_PARKED
+    int count;
+};
+
+// true for the wait events that are summarized while sampling
+bool logSampleCandidate(uint8_t type, int arg);
+
+// true while wait events are summarized
+bool logSamplingActive();
+
+// Server: add lines logged to the current window and close the window once LOG_WINDOW_NS
+// have passed, returns 1 if that turned sampling on, -1 if it turned it off, 0 otherwise
+int logSamplerAdd(long lines);
+
+// Train: count a wait event instead of logging it
+void trainSampleWait(uint8_t type, int intersectionIdx);
+
+// Train: waits counted for the intersection since the last call
+int trainTakeSampledWaits(int intersectionIdx);
+
+// Server: count a wait event instead of logging it
+void serverSampleWait(uint8_t type, int trainIdx, int intersectionIdx);
+
+// Server: take the waits counted for the train on the intersection (-1 for any), false if none are left
+bool serverTakeSampledWait(int trainIdx, int intersectionIdx, SampledWait& wait);
+
+// Server: forget every counted wait (daemon workers, between runs)
+void serverResetSampledWaits();
+
+#endif
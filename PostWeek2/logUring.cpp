@@ -0,0 +1,370 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: io_uring log writer. Only the logger thread calls it,
+    so none of this state is locked. The submission and completion rings are
+    shared with the kernel: tails are published with release stores and read
+    with acquire loads, as the io_uring interface requires.
+*/
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "logUring.h"
+#include "TrainCommunication.h"
+
+// a write waiting for, or using, one target
+struct UringWrite {
+    int buffer;         // registered buffer index
+    size_t length;      // bytes of the buffer to write
+    size_t done;        // bytes already written (short writes are continued)
+};
+
+// the console or the log file, registered as a fixed file
+struct UringTarget {
+    int fd;
+    std::deque<UringWrite> queued;  // front is in flight when inFlight is set
+    bool inFlight = false;
+};
+
+struct UringState {
+    int ringFd = -1;
+    void *sqRing = MAP_FAILED;
+    void *cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = (io_uring_sqe *)MAP_FAILED;
+    size_t sqesSize = 0;
+
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe *cqes;
+    unsigned toSubmit = 0;          // SQEs prepared since the last io_uring_enter
+
+    std::vector<char *> buffers;    // registered buffers
+    std::vector<int> users;         // targets still writing each buffer
+    std::vector<int> freeBuffers;
+    size_t bufferSize = 0;
+    std::vector<UringTarget> targets;
+};
+
+static UringState ring;
+
+static int uringSetup(unsigned entries, io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, ring.ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(unsigned opcode, const void *arg, unsigned count)
+{
+    return syscall(__NR_io_uring_register, ring.ringFd, opcode, arg, count);
+}
+
+/* unmapRing releases whatever uringWriterStart managed to set up */
+static void unmapRing()
+{
+    if (ring.sqes != MAP_FAILED)
+    {
+        munmap(ring.sqes, ring.sqesSize);
+    }
+    if (ring.cqRing != MAP_FAILED && ring.cqRing != ring.sqRing)
+    {
+        munmap(ring.cqRing, ring.cqRingSize);
+    }
+    if (ring.sqRing != MAP_FAILED)
+    {
+        munmap(ring.sqRing, ring.sqRingSize);
+    }
+    if (ring.ringFd != -1)
+    {
+        close(ring.ringFd);
+    }
+    for (char *buffer : ring.buffers)
+    {
+        free(buffer);
+    }
+    ring = UringState();
+}
+
+/*
+* uringWriterStart creates a ring with room for a write per buffer and target, maps its queues,
+* registers the buffers and the targets. Writes use the current file position (offset -1), which
+* needs IORING_FEAT_RW_CUR_POS (Linux 5.6).
+* output: false if any step fails, the caller then writes with write()
+*/
+bool uringWriterStart(int consoleFd, int fileFd, int bufferCount, size_t bufferSize)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring.ringFd = uringSetup(bufferCount * 2, &params);
+    if (ring.ringFd == -1)
+    {
+        std::cerr << "uringWriterStart [ERROR]: io_uring_setup: " << strerror(errno) << std::endl;
+        ring = UringState();
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        std::cerr << "uringWriterStart [ERROR]: kernel cannot write at the current file position" << std::endl;
+        unmapRing();
+        return false;
+    }
+
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring.sqRingSize = ring.cqRingSize = std::max(ring.sqRingSize, ring.cqRingSize);
+    }
+    ring.sqRing = mmap(NULL, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.ringFd, IORING_OFF_SQ_RING);
+    if (ring.sqRing != MAP_FAILED)
+    {
+        ring.cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring.sqRing
+            : mmap(NULL, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.ringFd, IORING_OFF_CQ_RING);
+    }
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    if (ring.cqRing != MAP_FAILED)
+    {
+        ring.sqes = (io_uring_sqe *)mmap(NULL, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.ringFd, IORING_OFF_SQES);
+    }
+    if (ring.sqes == MAP_FAILED)
+    {
+        std::cerr << "uringWriterStart [ERROR]: mmap: " << strerror(errno) << std::endl;
+        unmapRing();
+        return false;
+    }
+
+    char *sq = static_cast<char *>(ring.sqRing);
+    char *cq = static_cast<char *>(ring.cqRing);
+    ring.sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    ring.sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring.sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring.sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    ring.cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring.cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring.cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    // registered buffers are pinned once here instead of on every write
+    std::vector<iovec> iov(bufferCount);
+    ring.bufferSize = bufferSize;
+    for (int b = 0; b < bufferCount; b++)
+    {
+        ring.buffers.push_back(static_cast<char *>(malloc(bufferSize)));
+        if (ring.buffers.back() == nullptr)
+        {
+            std::cerr << "uringWriterStart [ERROR]: out of memory for the log buffers" << std::endl;
+            unmapRing();
+            return false;
+        }
+        iov[b].iov_base = ring.buffers.back();
+        iov[b].iov_len = bufferSize;
+        ring.freeBuffers.push_back(b);
+    }
+    ring.users.assign(bufferCount, 0);
+    if (uringRegister(IORING_REGISTER_BUFFERS, iov.data(), bufferCount) == -1)
+    {
+        std::cerr << "uringWriterStart [ERROR]: registering buffers: " << strerror(errno) << std::endl;
+        unmapRing();
+        return false;
+    }
+
+    // fixed files save the file table lookup on every write
+    std::vector<int> fds;
+    if (consoleFd != -1)
+    {
+        fds.push_back(consoleFd);
+    }
+    fds.push_back(fileFd);
+    if (uringRegister(IORING_REGISTER_FILES, fds.data(), fds.size()) == -1)
+    {
+        std::cerr << "uringWriterStart [ERROR]: registering files: " << strerror(errno) << std::endl;
+        unmapRing();
+        return false;
+    }
+    for (int fd : fds)
+    {
+        UringTarget target;
+        target.fd = fd;
+        ring.targets.push_back(target);
+    }
+    return true;
+}
+
+/* prepareWrite fills an SQE for the rest of the target's front write, submitted with the next enter */
+static void prepareWrite(int t)
+{
+    UringTarget &target = ring.targets[t];
+    const UringWrite &write = target.queued.front();
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & *ring.sqMask;
+    io_uring_sqe *sqe = &ring.sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = t;                                // index in the registered files
+    sqe->off = (uint64_t)-1;                    // current position (O_APPEND for the log file)
+    sqe->addr = (uint64_t)(uintptr_t)(ring.buffers[write.buffer] + write.done);
+    sqe->len = write.length - write.done;
+    sqe->buf_index = write.buffer;
+    sqe->user_data = t;
+
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring.toSubmit++;
+    target.inFlight = true;
+}
+
+/* startIdleTargets gives every target that has nothing in flight its next queued write */
+static void startIdleTargets()
+{
+    for (size_t t = 0; t < ring.targets.size(); t++)
+    {
+        if (!ring.targets[t].inFlight && !ring.targets[t].queued.empty())
+        {
+            prepareWrite(t);
+        }
+    }
+}
+
+/* reapCompletions handles every finished write, without a system call */
+static void reapCompletions()
+{
+    unsigned head = *ring.cqHead;
+    unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+        UringTarget &target = ring.targets[cqe->user_data];
+        UringWrite &write = target.queued.front();
+        target.inFlight = false;
+
+        if (cqe->res < 0)
+        {
+            std::cerr << "uringWriter [ERROR]: write failed: " << strerror(-cqe->res) << std::endl;
+            write.done = write.length; // give up on this buffer rather than spin on it
+        }
+        else
+        {
+            write.done += cqe->res;
+        }
+        if (write.done >= write.length || cqe->res == 0)
+        {
+            if (--ring.users[write.buffer] == 0)
+            {
+                ring.freeBuffers.push_back(write.buffer);
+            }
+            target.queued.pop_front();
+        }
+        head++;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    startIdleTargets();
+}
+
+/* submit hands the prepared SQEs to the kernel, waiting for minComplete completions */
+static void submit(unsigned minComplete)
+{
+    if (ring.toSubmit == 0 && minComplete == 0)
+    {
+        return;
+    }
+    int submitted = uringEnter(ring.toSubmit, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (submitted == -1)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            std::cerr << "uringWriter [ERROR]: io_uring_enter: " << strerror(errno) << std::endl;
+        }
+        return;
+    }
+    if (ring.toSubmit > 0)
+    {
+        serverStats.logWrites++;
+    }
+    ring.toSubmit -= std::min<unsigned>(submitted, ring.toSubmit);
+}
+
+/*
+* uringWriterWrite copies data into free registered buffers and queues each one for every target.
+* All writes it queues go to the kernel in one io_uring_enter. Only when every buffer is still
+* being written does it wait for a completion.
+*/
+void uringWriterWrite(const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        while (ring.freeBuffers.empty())
+        {
+            submit(1);
+            reapCompletions();
+        }
+        int buffer = ring.freeBuffers.back();
+        ring.freeBuffers.pop_back();
+
+        size_t chunk = std::min(length, ring.bufferSize);
+        memcpy(ring.buffers[buffer], data, chunk);
+        ring.users[buffer] = ring.targets.size();
+        for (UringTarget &target : ring.targets)
+        {
+            target.queued.push_back(UringWrite{buffer, chunk, 0});
+        }
+        data += chunk;
+        length -= chunk;
+        startIdleTargets();
+    }
+    submit(0);
+    reapCompletions();
+}
+
+/* uringWriterPoll moves finished writes along, with drain until nothing is left */
+void uringWriterPoll(bool drain)
+{
+    reapCompletions();
+    submit(0);
+    while (drain && uringWriterBusy())
+    {
+        submit(1);
+        reapCompletions();
+    }
+}
+
+/* uringWriterBusy reports writes that are queued or in flight */
+bool uringWriterBusy()
+{
+    for (const UringTarget &target : ring.targets)
+    {
+        if (!target.queued.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* uringWriterStop finishes every write and tears the ring down (the targets stay open) */
+void uringWriterStop()
+{
+    if (ring.ringFd == -1)
+    {
+        return;
+    }
+    uringWriterPoll(true);
+    unmapRing();
+}
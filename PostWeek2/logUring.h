@@ -0,0 +1,33 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: io_uring backend for the server logger thread
+    (--log-writer=uring). The log file and the console are registered as fixed
+    files and a small pool of registered buffers holds the data in flight, so the
+    logger thread copies a flushed half of its double buffer into a free buffer,
+    queues the writes and goes back to waiting; one io_uring_enter submits them
+    and picks up finished ones. Writes to each target stay in order (one in
+    flight per target). Uses the raw system calls, no liburing needed.
+*/
+
+#ifndef LOG_URING_H
+#define LOG_URING_H
+
+#include <cstddef>
+
+// Set up the ring, register bufferCount buffers of bufferSize bytes and the targets
+// (consoleFd may be -1), returns false if io_uring is not available
+bool uringWriterStart(int consoleFd, int fileFd, int bufferCount, size_t bufferSize);
+
+// Queue data for every target, copied into registered buffers (waits only if all are in use)
+void uringWriterWrite(const char *data, size_t length);
+
+// Submit queued writes and reap finished ones, with drain wait until every write is done
+void uringWriterPoll(bool drain);
+
+// true while writes are queued or in flight
+bool uringWriterBusy();
+
+// Wait for every write, unregister and close the ring
+void uringWriterStop();
+
+#endif
@@ -28,6 +28,17 @@
 #include "TrainCommunication.h"
 #include "trainCommExtension.h"
 #include "DeadlockDetection.h"
+#include "SimConfig.h"
+#include "serverEventLoop.h"
+#include "trainMailbox.h"
+#include "queueTelemetry.h"
+#include "trainSocket.h"
+#include "serverShards.h"
+#include "serverThreads.h"
+#include "Partitioner.h"
+#include "simDaemon.h"
+#include "serverLogger.h"
+#include "logRing.h"
 
 using namespace std;
 
@@ -40,6 +51,7 @@ int logQueue = 0;
 int waitQueue = 0;
 
 shared_mem_t* shm_ptr = nullptr;
+vector<string> trainNames; // train names in index order, index is the row in held/waiting
 /* From Resouce ALlocation */
 /* Print Resource ALlocation Table */
 void printIntersectionStatus1(shared_mem_t *shm)
@@ -97,7 +109,7 @@ void printIntersectionStatus1(shared_mem_t *shm)
             {
                 if (!one) /* Multiple elements separate with comma */
                     cout << ", ";
-                cout << "Train" << t; /* Trains Id */
+                cout << trainNames[t]; /* Trains Id */
                 one = false;
             }
         }
@@ -113,14 +125,14 @@ void printIntersectionStatus1(shared_mem_t *shm)
  *  input: vector of strings for the route
  *  input: requestQueue and responseQueue for message queue
  */
-void child_process(const char *train, vector<string> route, int requestQueue, int responseQueue, int logQueue,
-                       int waitQueue, shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *semaphore, pthread_mutex_t *mutex)
+void child_process(int trainIdx, vector<string> route, int requestQueue, int responseQueue, int logQueue,
+                       shared_mem_t *shm, Intersection *inter_ptr)
 {
     // child_process takes path and train information
     // child_process will use message queue to acquire and release semaphore and mutex locks
     //printIntersectionStatus1(shm);
     // std::cout << "Child process for train: " << train << "\nPID: " << getpid() << std::endl;
-    simulateTrainMovement(train, route, requestQueue, responseQueue, logQueue, waitQueue, shm, inter_ptr, held, semaphore, mutex); // simulate train movement
+    simulateTrainMovement(trainIdx, route, requestQueue, responseQueue, logQueue, shm, inter_ptr); // simulate train movement
 }
 
 // cleanup message queues on failure
@@ -131,15 +143,15 @@ void cleanUpOnFail(int){
 
 
 /* This function forks the child processes for each train
- *  input: unordered map of trains and their routes
+ *  input: unordered map of trains and their routes, forked in trainNames order
  *  input: requestQueue and responseQueue for message queue
  *  output: vector of child PIDs
  */
 vector<pid_t> forkTrains(unordered_map<string, vector<string>> trains, int requestQueue, int responseQueue, int logQueue,
-                         int waitQueue, shared_mem_t *shm, Intersection *inter_ptr, int *held, sem_t *semaphore, pthread_mutex_t *mutex)
+                         shared_mem_t *shm, Intersection *inter_ptr)
 {
     vector<pid_t> childPIDS;
-    for (auto iter : trains)
+    for (size_t trainIdx = 0; trainIdx < trainNames.size(); trainIdx++)
     {
         pid_t pid = fork();
         
@@ -151,14 +163,10 @@ vector<pid_t> forkTrains(unordered_map<string, vector<string>> trains, int reque
         }
         else if (pid == 0)
         { // Child process
-            // cout << "Forked process for train: " << iter.first << "\nPID: " << getpid() << endl;
-            char trainID[16];
-            strncpy(trainID, iter.first.c_str(), sizeof(trainID) - 1);
-            trainID[sizeof(trainID) - 1] = '\0'; // null termination to reduce junk errors
+            // cout << "Forked process for train: " << trainNames[trainIdx] << "\nPID: " << getpid() << endl;
 
             // run the child process in the fork
-            child_process(trainID, iter.second, requestQueue, responseQueue, logQueue, waitQueue,
-                          shm, inter_ptr, held, semaphore, mutex);
+            child_process(trainIdx, trains[trainNames[trainIdx]], requestQueue, responseQueue, logQueue, shm, inter_ptr);
             exit(0); // Child process exits after running
         }
         else
@@ -209,10 +217,12 @@ void parseTrains(const string &filename, unordered_map<string, vector<string>> &
 
 
 
-/* main handles server side, sets up message queues, forks child processes
- * sets up shared memory, logging.
+/* runSimulation runs one simulation from data/intersections.txt and data/trains.txt in the
+ * current directory: sets up shared memory and logging, forks the trains and serves them.
+ * The message queues are set up by the caller, main or a daemon worker that reuses its own.
+ * output: 0 once every train has finished, -1 if the run could not be set up
  */
-int main()
+int runSimulation()
 {
     pid_t serverPID = getpid(); // get server process ID
     
@@ -223,6 +233,15 @@ int main()
     parseIntersections("data/intersections.txt", intersections);
     parseTrains("data/trains.txt", trains); // Replace commented-out parseFile line
 
+    // give every train a dense index (row in held/waiting), ordered Train1, Train2, ..., Train10
+    for (auto &iter : trains)
+    {
+        trainNames.push_back(iter.first);
+    }
+    sort(trainNames.begin(), trainNames.end(), [](const string &a, const string &b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+
     char fileName[] = "data/simulation.log";
 
     int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
@@ -279,6 +298,11 @@ int main()
     
     // use calculated number of intersections for mutex and semaphore to provide size for shared memory
     void *ptr = mem.mem_setup(num_mutex, num_sem, sem_values, num_trains);
+    if (ptr == nullptr)
+    {
+        cerr << "Main [ERROR]: Could not set up shared memory.\n";
+        return -1;
+    }
     shm_ptr = reinterpret_cast<shared_mem_t*>(ptr); 
 
     signal(SIGINT, cleanUpOnFail);
@@ -329,20 +353,109 @@ int main()
 
    
 
-    if (setupMessageQueues(requestQueue, responseQueue, logQueue, waitQueue) == -1)
+    if (simConfig.transport == Transport::MAILBOX && !mailboxSetup(num_trains))
     {
-        cerr << "Main [ERROR]: Could not set up message queues.\n";
+        cerr << "Main [ERROR]: Could not set up the train mailboxes.\n";
+        return -1;
+    }
+
+    // forked trains log through their own ring, socket clients send their log lines over the socket
+    if (simConfig.transport != Transport::SOCKET && simConfig.logRingSlots > 0 && !logRingSetup(num_trains, simConfig.logRingSlots))
+    {
+        cerr << "Main [ERROR]: Could not set up the train log rings.\n";
         return -1;
     }
 
+    // routes as intersection indices, for the partitioner and the socket clients
+    vector<vector<int>> routes(trainNames.size());
+    bool routesKnown = true;
+    for (size_t t = 0; t < trainNames.size(); t++)
+    {
+        for (const string &name : trains[trainNames[t]])
+        {
+            Intersection *found = findIntersectionbyID(name.c_str(), inter_ptr, intersections.size());
+            if (found == nullptr)
+            {
+                // forked trains report this themselves and stop
+                routesKnown = false;
+                continue;
+            }
+            routes[t].push_back(found->index);
+        }
+    }
+
+    if (!setupPartition(routes, inter_ptr, intersections.size()))
+    {
+        cerr << "Main [ERROR]: Could not set up the intersection partition.\n";
+        return -1;
+    }
+
+    if (simConfig.transport == Transport::SOCKET)
+    {
+        // the server hands each client its route as intersection indices
+        if (!routesKnown)
+        {
+            cerr << "Main [ERROR]: trains.txt has a route with an unknown intersection.\n";
+            return -1;
+        }
+        if (!socketServerSetup(simConfig.socketPath, routes))
+        {
+            cerr << "Main [ERROR]: Could not set up the train socket.\n";
+            return -1;
+        }
+    }
+
+    if (simConfig.shards > 1 && !setupShards(requestQueue, waitQueue))
+    {
+        cerr << "Main [ERROR]: Could not set up the server shards.\n";
+        cleanupShards();
+        return -1;
+    }
+
+    if (simConfig.eventLoop && !setupEventLoop())
+    {
+        cerr << "Main [ERROR]: Could not set up the server event loop.\n";
+        return -1;
+    }
+
+    // binary log: the header names every train and intersection once, the records only carry indices
+    if (simConfig.logFormat == LogFormat::BINARY)
+    {
+        vector<string> intersectionNames;
+        for (size_t i = 0; i < intersections.size(); i++)
+        {
+            intersectionNames.push_back(inter_ptr[i].name);
+        }
+        if (!openEventLog("data/simulation.bin", intersectionNames))
+        {
+            cerr << "Main [ERROR]: Could not create data/simulation.bin.\n";
+            return -1;
+        }
+        cout << "Logging event records to data/simulation.bin, decode them with LogDecode." << endl;
+    }
+
     // Used to create resource allocation graph
     printIntersectionStatus1(shm_ptr); /* print resource allocation table*/
 
-    logMessage("SERVER: Initialized intersections");
+    if (logEnabled(LogCategory::SERVER, LogLevel::INFO))
+    {
+        logMessage("SERVER: Initialized intersections");
+    }
     cout << endl;
 
-    // create child processes for each train and store their PIDs
-    vector<pid_t> childPIDS = forkTrains(trains, requestQueue, responseQueue, logQueue, waitQueue, shm_ptr, inter_ptr, held, semaphore, mutex); // fork the number of trains
+    // the other shards run as their own server processes, this process is shard 0
+    vector<pid_t> shardPIDS = forkShardServers(responseQueue, logQueue, shm_ptr, inter_ptr, held, semaphore, mutex, waiting);
+
+    // create child processes for each train and store their PIDs, socket trains are started separately
+    vector<pid_t> childPIDS;
+    if (simConfig.transport == Transport::SOCKET)
+    {
+        cout << "Waiting for " << num_trains << " train clients on " << simConfig.socketPath << " (--client=TrainN)" << endl;
+    }
+    else
+    {
+        childPIDS = forkTrains(trains, requestQueue, responseQueue, logQueue, shm_ptr, inter_ptr); // fork the number of trains
+    }
 
 
     // run the server process
@@ -350,17 +463,53 @@ int main()
     { // if the process is the parent process, run the server side
     
         
+        // all forks are done, the logger thread now owns the log file for this process
+        if (simConfig.asyncLog)
+        {
+            startServerLogger("data/simulation.log");
+        }
+
         detectAndResolveDeadlock(shm_ptr, intersections); // pass in shared memory pointer and vector of intersections
 
-        processTrainRequests(requestQueue, responseQueue, logQueue, waitQueue, shm_ptr, inter_ptr, held, semaphore, mutex, waiting); // process train requests
+        // queues the server samples for depth telemetry, the mailbox replaces the request/response queues
+        if (simConfig.transport != Transport::SOCKET)
+        {
+            telemetryTrackQueue("request", simConfig.transport == Transport::MAILBOX ? -1 : requestQueue);
+            telemetryTrackQueue("response", simConfig.transport == Transport::MAILBOX ? -1 : responseQueue);
+        }
+        telemetryTrackQueue("log", logQueue);
+        telemetryTrackQueue("wait", waitQueue);
+
+        if (simConfig.eventLoop)
+        {
+            processTrainRequestsEventLoop(requestQueue, responseQueue, logQueue, waitQueue, shm_ptr, inter_ptr, held, semaphore, mutex, waiting, childPIDS);
+        }
+        else if (simConfig.threads > 1)
+        {
+            processTrainRequestsThreaded(requestQueue, responseQueue, logQueue, waitQueue, shm_ptr, inter_ptr, held, semaphore, mutex, waiting);
+        }
+        else
+        {
+            processTrainRequests(requestQueue, responseQueue, logQueue, waitQueue, shm_ptr, inter_ptr, held, semaphore, mutex, waiting); // process train requests
+        }
     
         for (auto &pid : childPIDS)
 
         { // wait for the child processes to finish
             waitpid(pid, nullptr, 0);
         }
+        for (auto &pid : shardPIDS)
+        { // the other shards stop after the last DONE too
+            waitpid(pid, nullptr, 0);
+        }
         cout << "All trains have finished." << endl;
-        logMessage("All trains have finished.");
+        if (logEnabled(LogCategory::SERVER, LogLevel::INFO))
+        {
+            logMessage("All trains have finished.");
+        }
+        stopServerLogger();
+        printServerStats();
+        printQueueTelemetry(shm_ptr);
     }
     
     // close logFile is the process is a child process
@@ -373,8 +522,15 @@ int main()
     } */
 
     // after process is finished, cleanup
-    // cleanup message queues
-    cleanupMessageQueues(requestQueue, responseQueue, logQueue, waitQueue);
+    mailboxClose();
+    logRingClose();
+    closeEventLog();
+    cleanupShards();
+    socketServerClose();
+    if (simConfig.eventLoop)
+    {
+        closeEventLoop();
+    }
 
    // logFile.close(); // close logFile
 
@@ -384,3 +540,43 @@ int main()
     
     return 0;
 }
+
+/* main handles server side, sets up message queues and runs the simulation,
+ * or runs as the simulation daemon, a job submitter or an external train client.
+ */
+int main(int argc, char *argv[])
+{
+    if (!parseSimConfig(argc, argv))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // an external train client only needs the server's socket, no data files, memory or queues
+    if (simConfig.clientTrain != nullptr)
+    {
+        return runSocketClient(simConfig.clientTrain);
+    }
+
+    // the daemon's workers set up their own queues once and reuse them for every job
+    if (simConfig.daemonWorkers > 0)
+    {
+        return runDaemon();
+    }
+    if (simConfig.submitDir != nullptr)
+    {
+        return submitDaemonJob(argc, argv);
+    }
+
+    if (setupMessageQueues(requestQueue, responseQueue, logQueue, waitQueue) == -1)
+    {
+        cerr << "Main [ERROR]: Could not set up message queues.\n";
+        return -1;
+    }
+
+    int status = runSimulation();
+
+    // cleanup message queues
+    cleanupMessageQueues(requestQueue, responseQueue, logQueue, waitQueue);
+    return status;
+}
@@ -0,0 +1,363 @@
+/*  Group G
+    Date: 4/25/2025
+    Program Description: Queue depth sampling, high-water marks and send-side
+    overflow handling for the System V message queues.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <sys/msg.h>
+
+#include "queueTelemetry.h"
+#include "serverEventLoop.h"
+#include "trainMailbox.h"
+#include "SimConfig.h"
+
+ipc_counters_t responseSend = {0, 0, 0, 0, 0};
+
+// queues sampled by the server
+static std::vector<QueueDepth> trackedQueues;
+
+// log messages a train kept while the log queue was full (spill policy), per process
+static std::deque<LogMsg> logSpill;
+
+// log messages seen while the log queue was full (sample policy), per process
+static long overflowSeen = 0;
+
+// wait entries the server kept while its wait queue was full, all newer than the queued ones
+static std::deque<WaitQueueMsg> waitSpill;
+
+// cleared once the system limit (msgmnb) stops the wait queue from growing
+static bool waitQueueGrowable = true;
+
+/* nowNs reads the monotonic clock in nanoseconds */
+static long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* telemetryTrackQueue adds a queue to the sampled set, queue is -1 for a mailbox pseudo queue */
+void telemetryTrackQueue(const char *name, int queue)
+{
+    QueueDepth depth;
+    depth.name = name;
+    depth.queue = queue;
+    trackedQueues.push_back(depth);
+}
+
+/* recordSample updates the high-water marks of one queue */
+static void recordSample(QueueDepth &depth, unsigned long messages, unsigned long bytes, unsigned long capacity)
+{
+    depth.samples++;
+    depth.messages = messages;
+    depth.capacity = capacity;
+    if (messages > depth.maxMessages)
+    {
+        depth.maxMessages = messages;
+    }
+    if (bytes > depth.maxBytes)
+    {
+        depth.maxBytes = bytes;
+    }
+    // near full: 90% used, or one more message of the average size would not fit
+    if (capacity > 0 && (bytes * 10 >= capacity * 9 || (messages > 0 && bytes + bytes / messages > capacity)))
+    {
+        depth.nearFull++;
+    }
+}
+
+/*
+* sampleQueueDepths reads the current depth of every tracked queue. System V queues use
+* msgctl(IPC_STAT); the mailbox transport reports pending request bits and unread responses,
+* with bytes counted as slots so the percentage of capacity still means something.
+*/
+void sampleQueueDepths()
+{
+    for (QueueDepth &depth : trackedQueues)
+    {
+        if (depth.queue == -1)
+        {
+            int pendingRequests = 0;
+            int unreadResponses = 0;
+            int trains = mailboxDepth(pendingRequests, unreadResponses);
+            if (strcmp(depth.name, "request") == 0)
+            {
+                recordSample(depth, pendingRequests, pendingRequests, trains);
+            }
+            else
+            {
+                recordSample(depth, unreadResponses, unreadResponses, (unsigned long)trains * MAILBOX_RESPONSES);
+            }
+            continue;
+        }
+
+        struct msqid_ds info;
+        if (msgctl(depth.queue, IPC_STAT, &info) == -1)
+        {
+            continue;
+        }
+        recordSample(depth, info.msg_qnum, info.__msg_cbytes, info.msg_qbytes);
+    }
+}
+
+/*
+* sendWithBackpressure sends without blocking first. If the queue is full the event is counted
+* and the send blocks, with the blocked time added to the counters, so a stall is never silent.
+*/
+bool sendWithBackpressure(int queue, const void *msg, size_t size, ipc_counters_t *counters)
+{
+    __atomic_fetch_add(&counters->sends, 1, __ATOMIC_RELAXED);
+    if (msgsnd(queue, msg, size, IPC_NOWAIT) == 0)
+    {
+        return true;
+    }
+    if (errno != EAGAIN)
+    {
+        return false;
+    }
+
+    __atomic_fetch_add(&counters->fullEvents, 1, __ATOMIC_RELAXED);
+    long start = nowNs();
+    int rc;
+    while ((rc = msgsnd(queue, msg, size, 0)) == -1 && errno == EINTR)
+    {
+    }
+    __atomic_fetch_add(&counters->blockedNs, nowNs() - start, __ATOMIC_RELAXED);
+    return rc == 0;
+}
+
+/* moveSpilledWaits puts spilled wait entries back on the wait queue in order while it has room */
+static void moveSpilledWaits(int waitQueue)
+{
+    while (!waitSpill.empty() && msgsnd(waitQueue, &waitSpill.front(), sizeof(WaitQueueMsg) - sizeof(long), IPC_NOWAIT) == 0)
+    {
+        waitSpill.pop_front();
+    }
+}
+
+/* growQueue doubles msg_qbytes of a queue, which fails past msgmnb without CAP_SYS_RESOURCE */
+static bool growQueue(int queue)
+{
+    struct msqid_ds info;
+    if (msgctl(queue, IPC_STAT, &info) == -1)
+    {
+        return false;
+    }
+    info.msg_qbytes *= 2;
+    return msgctl(queue, IPC_SET, &info) == 0;
+}
+
+/*
+* sendWaitEntry adds an entry to the server's wait queue. The server is the only reader of that
+* queue, so blocking on it would never end. When it is full it is grown, and once the system limit
+* stops that the entry goes to a local spill behind the queued ones; processWaitQueue takes from the
+* spill when the queue is empty, so entries still come out in the order they were added.
+*/
+bool sendWaitEntry(int waitQueue, const WaitQueueMsg &msg, ipc_counters_t *counters)
+{
+    __atomic_fetch_add(&counters->sends, 1, __ATOMIC_RELAXED);
+    moveSpilledWaits(waitQueue);
+    if (waitSpill.empty() && msgsnd(waitQueue, &msg, sizeof(WaitQueueMsg) - sizeof(long), IPC_NOWAIT) == 0)
+    {
+        return true;
+    }
+    if (waitSpill.empty() && errno != EAGAIN)
+    {
+        return false;
+    }
+    __atomic_fetch_add(&counters->fullEvents, 1, __ATOMIC_RELAXED);
+
+    if (waitQueueGrowable && !(waitQueueGrowable = growQueue(waitQueue)))
+    {
+        std::cerr << "sendWaitEntry: wait queue is full and cannot grow (" << strerror(errno)
+                  << "), keeping waits in memory" << std::endl;
+    }
+    if (waitQueueGrowable)
+    {
+        moveSpilledWaits(waitQueue);
+        if (waitSpill.empty() && msgsnd(waitQueue, &msg, sizeof(WaitQueueMsg) - sizeof(long), IPC_NOWAIT) == 0)
+        {
+            return true;
+        }
+    }
+    waitSpill.push_back(msg);
+    __atomic_fetch_add(&counters->spilled, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool takeSpilledWait(WaitQueueMsg &msg)
+{
+    if (waitSpill.empty())
+    {
+        return false;
+    }
+    msg = waitSpill.front();
+    waitSpill.pop_front();
+    return true;
+}
+
+int spilledWaits()
+{
+    return (int)waitSpill.size();
+}
+
+/* trySpilled sends spilled log messages in order until the queue is full again */
+static void trySpilled(int logQueue)
+{
+    while (!logSpill.empty())
+    {
+        if (msgsnd(logQueue, &logSpill.front(), sizeof(LogMsg) - sizeof(long), IPC_NOWAIT) == -1)
+        {
+            return;
+        }
+        logSpill.pop_front();
+        ringDoorbell(logDoorbell);
+    }
+}
+
+/*
+* sendLogWithPolicy sends a log message. When the log queue is full:
+*   block  - wait for room, with accounting (default)
+*   drop   - drop the message and count it
+*   sample - keep one in every simConfig.logSampleEvery messages (blocking for it), drop the rest
+*   spill  - keep it in a local buffer that is sent later, dropping only past simConfig.logSpillMax
+*/
+bool sendLogWithPolicy(int logQueue, const LogMsg &msg, ipc_counters_t *counters)
+{
+    if (simConfig.logOverflow == LogOverflow::BLOCK)
+    {
+        if (!sendWithBackpressure(logQueue, &msg, sizeof(LogMsg) - sizeof(long), counters))
+        {
+            return false;
+        }
+        ringDoorbell(logDoorbell);
+        return true;
+    }
+
+    // spilled messages go first so the order in the log is kept
+    if (simConfig.logOverflow == LogOverflow::SPILL)
+    {
+        trySpilled(logQueue);
+    }
+
+    __atomic_fetch_add(&counters->sends, 1, __ATOMIC_RELAXED);
+    if (logSpill.empty() && msgsnd(logQueue, &msg, sizeof(LogMsg) - sizeof(long), IPC_NOWAIT) == 0)
+    {
+        ringDoorbell(logDoorbell);
+        return true;
+    }
+    if (logSpill.empty() && errno != EAGAIN)
+    {
+        return false;
+    }
+    __atomic_fetch_add(&counters->fullEvents, 1, __ATOMIC_RELAXED);
+
+    switch (simConfig.logOverflow)
+    {
+    case LogOverflow::SPILL:
+        if ((int)logSpill.size() < simConfig.logSpillMax)
+        {
+            logSpill.push_back(msg);
+            __atomic_fetch_add(&counters->spilled, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+        break;
+    case LogOverflow::SAMPLE:
+        if (overflowSeen++ % simConfig.logSampleEvery == 0)
+        {
+            // sendWithBackpressure counts the send again
+            __atomic_fetch_sub(&counters->sends, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_sub(&counters->fullEvents, 1, __ATOMIC_RELAXED);
+            if (!sendWithBackpressure(logQueue, &msg, sizeof(LogMsg) - sizeof(long), counters))
+            {
+                return false;
+            }
+            ringDoorbell(logDoorbell);
+            return true;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // dropping is the policy working, not a send failure
+    __atomic_fetch_add(&counters->dropped, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/* flushLogSpill sends every spilled log message, blocking if needed */
+void flushLogSpill(int logQueue, ipc_counters_t *counters)
+{
+    while (!logSpill.empty())
+    {
+        if (!sendWithBackpressure(logQueue, &logSpill.front(), sizeof(LogMsg) - sizeof(long), counters))
+        {
+            break;
+        }
+        // counted as a send when it was spilled
+        __atomic_fetch_sub(&counters->sends, 1, __ATOMIC_RELAXED);
+        logSpill.pop_front();
+        ringDoorbell(logDoorbell);
+    }
+}
+
+/* printCounters prints the send-side accounting of one kind of traffic */
+static void printCounters(const char *name, const ipc_counters_t &c)
+{
+    std::cout << "  " << std::left << std::setw(10) << name << std::right
+              << " sends " << c.sends << ", found full " << c.fullEvents
+              << ", blocked " << std::fixed << std::setprecision(1) << c.blockedNs / 1000000.0 << std::defaultfloat << std::setprecision(6) << " ms"
+              << ", dropped " << c.dropped << ", spilled " << c.spilled << std::endl;
+}
+
+/*
+* printQueueTelemetry prints the high-water mark of every sampled queue and the send-side
+* accounting, and says whether IPC capacity (rather than intersections) was the bottleneck.
+*/
+void printQueueTelemetry(shared_mem_t *shm)
+{
+    bool ipcBound = false;
+
+    std::cout << "Queue telemetry:" << std::endl;
+    for (const QueueDepth &depth : trackedQueues)
+    {
+        double percent = depth.capacity ? 100.0 * depth.maxBytes / depth.capacity : 0.0;
+        std::cout << "  " << std::left << std::setw(10) << depth.name << std::right
+                  << " high-water " << depth.maxMessages << " msgs / " << depth.maxBytes
+                  << (depth.queue == -1 ? " slots" : " bytes") << " (" << std::fixed << std::setprecision(1)
+                  << percent << "% of " << depth.capacity << ")" << std::defaultfloat << std::setprecision(6)
+                  << ", near full in " << depth.nearFull << " of " << depth.samples << " samples" << std::endl;
+        if (depth.nearFull > 0)
+        {
+            ipcBound = true;
+        }
+    }
+
+    printCounters("request", shm->requestSend);
+    printCounters("response", responseSend);
+    printCounters("log", shm->logSend);
+    printCounters("wait", shm->waitSend);
+
+    if (shm->requestSend.fullEvents || responseSend.fullEvents || shm->logSend.fullEvents || shm->waitSend.fullEvents)
+    {
+        ipcBound = true;
+    }
+    std::cout << (ipcBound ? "  IPC capacity was a bottleneck in this run."
+                           : "  IPC capacity was not a bottleneck in this run.") << std::endl;
+}
+
+/* telemetryReset forgets the tracked queues and the response counters, for a daemon worker's next job */
+void telemetryReset()
+{
+    trackedQueues.clear();
+    memset(&responseSend, 0, sizeof(responseSend));
+    waitSpill.clear();
+    waitQueueGrowable = true;
+}
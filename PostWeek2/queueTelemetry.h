@@ -0,0 +1,63 @@
+/*  Group G
+    Date: 4/25/2025
+    Program Description: Queue depth telemetry and backpressure handling for the
+    message queues. The server samples the depth of the request, response, log and
+    wait queues and keeps high-water marks; senders account for the time they spend
+    blocked on a full queue, and log messages follow a configurable overflow policy
+    (block, drop, sample or spill to a local buffer) instead of stalling a train.
+*/
+
+#ifndef QUEUE_TELEMETRY_H
+#define QUEUE_TELEMETRY_H
+
+#include <cstddef>
+
+#include "shared_Mem.h"
+#include "trainCommExtension.h"
+
+// Depth samples for one queue, kept by the server
+struct QueueDepth {
+    const char *name;
+    int queue;                    // msqid, -1 for the mailbox transport
+    long samples = 0;
+    unsigned long messages = 0;   // depth at the last sample
+    unsigned long maxMessages = 0;
+    unsigned long maxBytes = 0;
+    unsigned long capacity = 0;   // msg_qbytes (bytes), or slots for the mailbox
+    long nearFull = 0;            // samples at 90% of capacity or with no room for another message
+};
+
+// Register a queue for depth sampling, call in the server before the loop starts
+void telemetryTrackQueue(const char *name, int queue);
+
+// Sample every registered queue (msgctl IPC_STAT, or the mailbox bitmap/rings)
+void sampleQueueDepths();
+
+// Send with accounting: try without blocking first, if the queue is full count it and block
+bool sendWithBackpressure(int queue, const void *msg, size_t size, ipc_counters_t *counters);
+
+// Send a log message following simConfig.logOverflow, returns false only if msgsnd failed
+bool sendLogWithPolicy(int logQueue, const LogMsg &msg, ipc_counters_t *counters);
+
+// Send what the spill policy kept locally, blocking; trains call this before DONE
+void flushLogSpill(int logQueue, ipc_counters_t *counters);
+
+// Server: add an entry to its own wait queue without ever blocking, growing the queue or spilling when full
+bool sendWaitEntry(int waitQueue, const WaitQueueMsg &msg, ipc_counters_t *counters);
+
+// Server: take the oldest spilled wait entry once the wait queue itself is empty
+bool takeSpilledWait(WaitQueueMsg &msg);
+
+// Server: number of wait entries spilled past the wait queue
+int spilledWaits();
+
+// Print high-water marks and send-side accounting
+void printQueueTelemetry(shared_mem_t *shm);
+
+// Forget the tracked queues and response counters before another run in the same process
+void telemetryReset();
+
+// Server side accounting for responses (only the server sends them)
+extern ipc_counters_t responseSend;
+
+#endif
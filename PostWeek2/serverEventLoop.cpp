@@ -0,0 +1,294 @@
+/*  Group G
+    Date: 4/23/2025
+    Program Description: epoll based server loop. Multiplexes the request and log
+    doorbells, the wait-queue retry timer, SIGCHLD through a signalfd and the
+    deadlock-detection tick, and handles whichever source is ready.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#include "serverEventLoop.h"
+#include "TrainCommunication.h"
+#include "trainCommExtension.h"
+#include "DeadlockDetection.h"
+#include "SimConfig.h"
+#include "queueTelemetry.h"
+#include "trainSocket.h"
+
+int requestDoorbell = -1;
+int logDoorbell = -1;
+
+/*
+* setupEventLoop creates the request and log doorbells and blocks SIGCHLD so child exits
+* are only seen through the signalfd. The trains inherit the doorbells when they are forked.
+* output: returns false if the eventfds could not be created
+*/
+bool setupEventLoop()
+{
+    requestDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    logDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (requestDoorbell == -1 || logDoorbell == -1)
+    {
+        std::cerr << "setupEventLoop [ERROR]: Failed to create doorbells: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    return true;
+}
+
+/* closeEventLoop closes the doorbells and unblocks SIGCHLD, so the next run in this process starts clean */
+void closeEventLoop()
+{
+    if (requestDoorbell != -1)
+    {
+        close(requestDoorbell);
+        requestDoorbell = -1;
+    }
+    if (logDoorbell != -1)
+    {
+        close(logDoorbell);
+        logDoorbell = -1;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+}
+
+/* ringDoorbell adds one to the eventfd counter, the server wakes up if it was waiting */
+void ringDoorbell(int doorbell)
+{
+    if (doorbell == -1)
+    {
+        return;
+    }
+    uint64_t one = 1;
+    // EAGAIN only happens when the counter is about to overflow, the server is awake then anyway
+    if (write(doorbell, &one, sizeof(one)) == -1 && errno != EAGAIN)
+    {
+        std::cerr << "ringDoorbell [ERROR]: " << strerror(errno) << std::endl;
+    }
+}
+
+/* createTimer makes a periodic timerfd, returns -1 if intervalMs is 0 (timer disabled) */
+static int createTimer(int intervalMs)
+{
+    if (intervalMs <= 0)
+    {
+        return -1;
+    }
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1)
+    {
+        std::cerr << "createTimer [ERROR]: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = intervalMs / 1000;
+    spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(fd, 0, &spec, nullptr);
+    return fd;
+}
+
+/* addToEpoll registers fd for input readiness, ignores disabled (-1) sources */
+static void addToEpoll(int epfd, int fd)
+{
+    if (fd == -1)
+    {
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        std::cerr << "addToEpoll [ERROR]: " << strerror(errno) << std::endl;
+    }
+}
+
+/* clearReady reads an eventfd/timerfd so it stops being readable */
+static void clearReady(int fd)
+{
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) == sizeof(count))
+    {
+    }
+}
+
+/*
+* processTrainRequestsEventLoop runs the server until every train has sent DONE or exited.
+* Requests are decided in batches exactly like processTrainRequests, but the server never
+* blocks on a single queue: it sleeps in epoll_wait and handles whichever source is ready.
+*/
+void processTrainRequestsEventLoop(int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting, const std::vector<pid_t>& childPIDs)
+{
+    std::vector<RequestMsg> reqs(simConfig.batchSize);
+    std::vector<char> trainDone(shm->num_trains, 0);
+    int trainsDone = 0;
+    ServerBatch batch;
+    WaiterLists waiters(shm->num_intersections); // parked ACQUIREs, only used with deferred grants
+
+    // intersections in table order for the deadlock detector
+    std::vector<Intersection> intersections(inter_ptr, inter_ptr + shm->num_intersections);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    int childExits = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    // the wait queue only needs a safety-net retry with the WAIT protocol
+    int waitTimer = simConfig.deferredGrant ? -1 : createTimer(simConfig.waitRetryMs);
+    int deadlockTimer = createTimer(simConfig.deadlockTickMs);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1 || childExits == -1)
+    {
+        std::cerr << "processTrainRequestsEventLoop [ERROR]: Failed to set up epoll: " << strerror(errno) << std::endl;
+        return;
+    }
+    addToEpoll(epfd, requestDoorbell);
+    addToEpoll(epfd, logDoorbell);
+    addToEpoll(epfd, childExits);
+    addToEpoll(epfd, waitTimer);
+    addToEpoll(epfd, deadlockTimer);
+    addToEpoll(epfd, socketPollFd());
+
+    // decide everything that is already queued, a batch at a time
+    auto handleRequests = [&]() {
+        int received;
+        while ((received = serverReceiveRequests(requestQueue, reqs.data(), simConfig.batchSize, false)) > 0)
+        {
+            trainsDone += serverDecideBatch(batch, reqs.data(), received, waitQueue, waiters, trainDone,
+                                            shm, inter_ptr, held, sem, mutex, waiting);
+            serverFlushBatch(responseQueue, batch);
+        }
+    };
+
+    struct epoll_event events[8];
+    while (trainsDone < shm->num_trains)
+    {
+        int ready = epoll_wait(epfd, events, 8, -1);
+        if (ready == -1)
+        {
+            if (errno != EINTR)
+            {
+                std::cerr << "processTrainRequestsEventLoop [ERROR]: epoll_wait: " << strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+
+        // sample on wake-up, before anything queued is taken
+        sampleQueueDepths();
+
+        for (int e = 0; e < ready; e++)
+        {
+            int fd = events[e].data.fd;
+
+            if (fd == requestDoorbell)
+            {
+                clearReady(fd);
+                handleRequests();
+            }
+            else if (fd == socketPollFd())
+            {
+                // socket clients: requests, logs and ticks arrive on the same connections
+                handleRequests();
+                trainsDone += serverAbandonDisconnected(batch, waitQueue, waiters, trainDone,
+                                                        shm, inter_ptr, held, sem, mutex, waiting);
+                serverFlushBatch(responseQueue, batch);
+            }
+            else if (fd == logDoorbell)
+            {
+                clearReady(fd);
+                serverDrainLogs(logQueue);
+            }
+            else if (fd == waitTimer)
+            {
+                clearReady(fd);
+                serverRetryWaitQueue(batch, waitQueue, shm, inter_ptr, held, sem, mutex, waiting, false);
+                serverFlushBatch(responseQueue, batch);
+            }
+            else if (fd == deadlockTimer)
+            {
+                clearReady(fd);
+                DeadlockCycle cycle;
+                if (checkForDeadlock(shm, cycle))
+                {
+                    if (logEnabled(LogCategory::DEADLOCK, LogLevel::INFO))
+                    {
+                        serverQueueLog(batch, "SERVER: Deadlock detected! Cycle: " + formatCycle(cycle, inter_ptr));
+                    }
+                    serverFlushBatch(responseQueue, batch);
+                    breakDeadlock(shm, inter_ptr, cycle);
+                    grantFreedCapacity(batch, waitQueue, waiters, shm, inter_ptr, held, sem, mutex, waiting);
+                    serverFlushBatch(responseQueue, batch);
+                }
+            }
+            else if (fd == childExits)
+            {
+                struct signalfd_siginfo info;
+                while (read(childExits, &info, sizeof(info)) == sizeof(info))
+                {
+                }
+
+                // a train sends DONE right before it exits, decide pending requests first
+                handleRequests();
+
+                pid_t pid;
+                while ((pid = waitpid(-1, nullptr, WNOHANG)) > 0)
+                {
+                    int trainIdx = -1;
+                    for (size_t t = 0; t < childPIDs.size(); t++)
+                    {
+                        if (childPIDs[t] == pid)
+                        {
+                            trainIdx = (int)t;
+                        }
+                    }
+                    if (trainIdx < 0)
+                    {
+                        continue;
+                    }
+
+                    // the train died without DONE, take back what it held so nobody waits on it forever
+                    trainsDone += serverAbandonTrain(batch, trainIdx, waitQueue, waiters, trainDone,
+                                                     shm, inter_ptr, held, sem, mutex, waiting);
+                }
+                serverFlushBatch(responseQueue, batch);
+            }
+        }
+    }
+
+    // trains log before sending DONE, pick up whatever is left
+    serverDrainLogs(logQueue);
+
+    close(epfd);
+    close(childExits);
+    if (waitTimer != -1)
+    {
+        close(waitTimer);
+    }
+    if (deadlockTimer != -1)
+    {
+        close(deadlockTimer);
+    }
+}
@@ -0,0 +1,36 @@
+/*  Group G
+    Date: 4/23/2025
+    Program Description: Single event loop for the server. Trains ring an eventfd
+    doorbell after every message they queue, so the server can wait on request
+    readiness, log readiness, the wait-queue retry timer, child exits (signalfd)
+    and deadlock-detection ticks at the same time with epoll, instead of blocking
+    on one message queue while another one fills up.
+*/
+
+#ifndef SERVER_EVENT_LOOP_H
+#define SERVER_EVENT_LOOP_H
+
+#include <vector>
+#include <sys/types.h>
+
+#include "shared_Mem.h"
+#include "Resource_Allocation.h"
+
+// eventfd doorbells, -1 unless the event loop is used
+extern int requestDoorbell;
+extern int logDoorbell;
+
+// Create the doorbells and block SIGCHLD for the signalfd, call before forking the trains
+bool setupEventLoop();
+
+// Close the doorbells and unblock SIGCHLD again, call after the server loop has returned
+void closeEventLoop();
+
+// Tell the server a message was queued (no-op when the event loop is not used)
+void ringDoorbell(int doorbell);
+
+// Event loop version of processTrainRequests, childPIDs[i] is the process of train index i
+void processTrainRequestsEventLoop(int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting, const std::vector<pid_t>& childPIDs);
+
+#endif
@@ -0,0 +1,214 @@
+/*  Group G
+    Date: 4/29/2025
+    Program Description: Double-buffered logger thread for the server. Producers
+    (the server loop, worker threads, deadlock handling) only append to the front
+    buffer under a mutex; the logger thread swaps buffers and does the I/O, so
+    nobody deciding requests waits on the file system.
+*/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "serverLogger.h"
+#include "logUring.h"
+#include "TrainCommunication.h"
+#include "SimConfig.h"
+
+struct LoggerState {
+    std::mutex lock;
+    std::condition_variable ready;     // front buffer reached the size threshold, or stopping
+    std::condition_variable drained;   // the halves were swapped, producers held back can append again
+    std::string front;                 // producers append here
+    std::string back;                  // the logger thread writes this one out
+    std::thread thread;
+    bool running = false;
+    bool stopping = false;
+    bool uring = false;                // writes go through logUring instead of write()
+    int fd = -1;
+};
+
+static LoggerState logger;
+
+/* writeAll writes the whole buffer, retrying short writes and interrupts */
+static void writeAll(int fd, const std::string& data)
+{
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "serverLogger [ERROR]: write failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        done += n;
+    }
+}
+
+/* writeOut writes a swapped-out buffer to the console and the log file */
+static void writeOut(const std::string& data)
+{
+    if (logger.uring)
+    {
+        // copied into a registered buffer and queued, the thread does not wait for the write
+        uringWriterWrite(data.data(), data.size());
+        return;
+    }
+    if (simConfig.logConsole)
+    {
+        writeAll(STDOUT_FILENO, data);
+    }
+    writeAll(logger.fd, data);
+    serverStats.logWrites++;
+}
+
+/*
+* loggerThread waits until the front buffer holds simConfig.logFlushBytes or simConfig.logFlushMs
+* has passed, swaps the buffers and writes the back one to the console and the log file. Returns
+* once it is stopping and everything has been written. With io_uring writes in flight it wakes
+* every millisecond to reap them and start the next ones.
+*/
+static void loggerThread()
+{
+    std::unique_lock<std::mutex> guard(logger.lock);
+    auto full = [] { return logger.stopping || logger.front.size() >= (size_t)simConfig.logFlushBytes; };
+    while (true)
+    {
+        if (logger.uring && uringWriterBusy())
+        {
+            logger.ready.wait_for(guard, std::chrono::milliseconds(1), full);
+        }
+        else if (simConfig.logFlushMs > 0)
+        {
+            logger.ready.wait_for(guard, std::chrono::milliseconds(simConfig.logFlushMs), full);
+        }
+        else
+        {
+            logger.ready.wait(guard, full);
+        }
+        if (logger.front.empty())
+        {
+            if (logger.stopping)
+            {
+                return;
+            }
+            if (logger.uring)
+            {
+                guard.unlock();
+                uringWriterPoll(false);
+                guard.lock();
+            }
+            continue;
+        }
+
+        logger.front.swap(logger.back);
+        logger.drained.notify_all();
+        guard.unlock();
+
+        writeOut(logger.back);
+        logger.back.clear(); // keeps its capacity for the next swap
+
+        guard.lock();
+    }
+}
+
+/*
+* startServerLogger opens the log file once and starts the logger thread. Threads do not survive
+* fork, so every server process (shards included) starts its own after it is done forking.
+* output: false if the file could not be opened, writeLogLines then keeps writing directly
+*/
+bool startServerLogger(const char *path)
+{
+    std::lock_guard<std::mutex> guard(logger.lock);
+    if (logger.running)
+    {
+        return true;
+    }
+    logger.fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (logger.fd == -1)
+    {
+        std::cerr << "startServerLogger [ERROR]: Failed to open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // a buffer holds what producers can add before they are held back (four flushes), eight of
+    // them let the thread keep swapping while earlier buffers are still being written
+    logger.uring = simConfig.logWriter == LogWriter::URING
+        && uringWriterStart(simConfig.logConsole ? STDOUT_FILENO : -1, logger.fd, 8, 4 * (size_t)simConfig.logFlushBytes);
+    if (simConfig.logWriter == LogWriter::URING && !logger.uring)
+    {
+        std::cerr << "startServerLogger: io_uring is not available, writing with write() instead" << std::endl;
+    }
+
+    // console output printed so far must come before the first flush
+    std::cout.flush();
+    logger.front.reserve(simConfig.logFlushBytes);
+    logger.back.reserve(simConfig.logFlushBytes);
+    logger.stopping = false;
+    logger.running = true;
+    logger.thread = std::thread(loggerThread);
+    return true;
+}
+
+/* stopServerLogger flushes what is buffered, joins the thread and closes the file */
+void stopServerLogger()
+{
+    {
+        std::lock_guard<std::mutex> guard(logger.lock);
+        if (!logger.running)
+        {
+            return;
+        }
+        logger.stopping = true;
+    }
+    logger.ready.notify_one();
+    logger.drained.notify_all();
+    logger.thread.join();
+    if (logger.uring)
+    {
+        uringWriterStop();
+        logger.uring = false;
+    }
+
+    std::lock_guard<std::mutex> guard(logger.lock);
+    close(logger.fd);
+    logger.fd = -1;
+    logger.running = false;
+    logger.stopping = false;
+}
+
+/*
+* serverLoggerAppend adds lines to the front buffer and wakes the logger once it is full. A producer
+* only waits when the front buffer has grown to four thresholds while the logger is still writing.
+*/
+bool serverLoggerAppend(const std::string& lines)
+{
+    std::unique_lock<std::mutex> guard(logger.lock);
+    if (!logger.running || logger.stopping)
+    {
+        return false;
+    }
+    logger.drained.wait(guard, [] { return logger.front.size() < 4 * (size_t)simConfig.logFlushBytes || logger.stopping; });
+    if (logger.stopping)
+    {
+        return false;
+    }
+    logger.front += lines;
+    if (logger.front.size() >= (size_t)simConfig.logFlushBytes)
+    {
+        logger.ready.notify_one();
+    }
+    return true;
+}
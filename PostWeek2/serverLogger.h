@@ -0,0 +1,25 @@
+/*  Group G
+    Date: 4/29/2025
+    Program Description: Asynchronous logger for the server process. Instead of
+    opening, locking, writing and closing data/simulation.log (and writing to the
+    console) for every batch of log lines, the server appends lines to the front
+    half of a double buffer and a logger thread that owns one open descriptor
+    swaps the halves and writes the back half out in one large write once it
+    reaches simConfig.logFlushBytes or simConfig.logFlushMs has passed.
+*/
+
+#ifndef SERVER_LOGGER_H
+#define SERVER_LOGGER_H
+
+#include <string>
+
+// Open the log file and start the logger thread; call in each server process after its last fork
+bool startServerLogger(const char *path);
+
+// Write everything still buffered and stop the thread; call before printing the end-of-run stats
+void stopServerLogger();
+
+// Append formatted lines, false if the logger is not running (the caller writes them itself)
+bool serverLoggerAppend(const std::string& lines);
+
+#endif
@@ -0,0 +1,139 @@
+/*  Group G
+    Date: 4/27/2025
+    Program Description: Intersection ownership, request routing and the extra server
+    processes for the sharded server mode.
+*/
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+
+#include "serverShards.h"
+#include "queueTelemetry.h"
+#include "SimConfig.h"
+#include "Partitioner.h"
+#include "serverLogger.h"
+
+extern shared_mem_t *shm_ptr;
+
+int currentShard = 0;
+
+// request and wait queue of every shard, index 0 is the main server's
+static std::vector<int> shardRequestQueues;
+static std::vector<int> shardWaitQueues;
+
+/* setupShards creates private queues for the extra shards, they are inherited through fork */
+bool setupShards(int requestQueue, int waitQueue)
+{
+    shardRequestQueues.assign(1, requestQueue);
+    shardWaitQueues.assign(1, waitQueue);
+    for (int s = 1; s < simConfig.shards; s++)
+    {
+        int shardRequests = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+        int shardWaits = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+        if (shardRequests == -1 || shardWaits == -1)
+        {
+            std::cerr << "setupShards [ERROR]: Failed to create queues for shard " << s << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        shardRequestQueues.push_back(shardRequests);
+        shardWaitQueues.push_back(shardWaits);
+    }
+    return true;
+}
+
+void cleanupShards()
+{
+    for (size_t s = 1; s < shardRequestQueues.size(); s++)
+    {
+        msgctl(shardRequestQueues[s], IPC_RMID, nullptr);
+        msgctl(shardWaitQueues[s], IPC_RMID, nullptr);
+    }
+    shardRequestQueues.resize(shardRequestQueues.empty() ? 0 : 1);
+    shardWaitQueues.resize(shardWaitQueues.empty() ? 0 : 1);
+}
+
+/* shardOf looks the owner up in the intersection partition */
+int shardOf(int intersectionIdx)
+{
+    return partitionOf(intersectionIdx);
+}
+
+/* sendToShard sends one request to one shard's request queue */
+static bool sendToShard(int shard, const RequestMsg& msg)
+{
+    return sendWithBackpressure(shardRequestQueues[shard], &msg, sizeof(msg) - sizeof(long), &shm_ptr->requestSend);
+}
+
+/*
+* shardSendRequest routes a train request. DONE goes to every shard so each one knows when
+* it can stop. A HANDOFF whose two intersections live on different shards cannot be decided
+* in one batch, so it is sent as a RELEASE to one shard and an ACQUIRE to the other.
+*/
+bool shardSendRequest(const RequestMsg& msg)
+{
+    if (msg.mtype == RequestType::DONE)
+    {
+        bool ok = true;
+        for (int s = 0; s < simConfig.shards; s++)
+        {
+            ok = sendToShard(s, msg) && ok;
+        }
+        return ok;
+    }
+
+    if (msg.mtype == RequestType::HANDOFF && shardOf(msg.release_id) != shardOf(msg.intersection_id))
+    {
+        RequestMsg release = msg;
+        release.mtype = RequestType::RELEASE;
+        release.intersection_id = msg.release_id;
+        release.release_id = -1;
+
+        RequestMsg acquire = msg;
+        acquire.mtype = RequestType::ACQUIRE;
+        acquire.release_id = -1;
+
+        return sendToShard(shardOf(release.intersection_id), release) && sendToShard(shardOf(acquire.intersection_id), acquire);
+    }
+
+    return sendToShard(shardOf(msg.intersection_id), msg);
+}
+
+/*
+* forkShardServers starts shards 1..N-1. Each one decides requests for the intersections it
+* owns until every train has sent DONE, prints its own stats and exits.
+*/
+std::vector<pid_t> forkShardServers(int responseQueue, int logQueue, shared_mem_t *shm, Intersection *inter_ptr,
+    int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting)
+{
+    std::vector<pid_t> shardPIDs;
+    for (int s = 1; s < simConfig.shards; s++)
+    {
+        pid_t pid = fork();
+        if (pid == -1)
+        {
+            std::cerr << "forkShardServers [ERROR]: Fork failed" << std::endl;
+            perror("fork");
+            exit(1);
+        }
+        else if (pid == 0)
+        {
+            currentShard = s;
+            if (simConfig.asyncLog)
+            {
+                startServerLogger("data/simulation.log");
+            }
+            processTrainRequests(shardRequestQueues[s], responseQueue, logQueue, shardWaitQueues[s], shm,
+                                 inter_ptr, held, sem, mutex, waiting);
+            stopServerLogger();
+            printServerStats();
+            exit(0);
+        }
+        shardPIDs.push_back(pid);
+    }
+    return shardPIDs;
+}
@@ -0,0 +1,41 @@
+/*  Group G
+    Date: 4/27/2025
+    Program Description: Sharded server mode. The intersection table is split across
+    several server processes by the intersection partitioner; each shard owns a slice of the intersections (their
+    columns of the held and waiting matrices) and has its own request and wait
+    queues. Trains send every request to the shard that owns the intersection, and
+    DONE to every shard. The resource allocation graph stays in shared memory, so
+    any shard can see wait edges written by the others when checking for cycles.
+*/
+
+#ifndef SERVER_SHARDS_H
+#define SERVER_SHARDS_H
+
+#include <vector>
+#include <sys/types.h>
+
+#include "shared_Mem.h"
+#include "Resource_Allocation.h"
+#include "TrainCommunication.h"
+
+// shard this server process is (0 is the main server process)
+extern int currentShard;
+
+// Create the request and wait queues of shards 1..N-1, shard 0 uses requestQueue and waitQueue
+bool setupShards(int requestQueue, int waitQueue);
+
+// Remove the extra shard queues
+void cleanupShards();
+
+// Shard that owns an intersection (see Partitioner.h)
+int shardOf(int intersectionIdx);
+
+// Send a train request to the owning shard(s): DONE goes to every shard, a HANDOFF that
+// crosses shards is split into a RELEASE and an ACQUIRE
+bool shardSendRequest(const RequestMsg& msg);
+
+// Fork the server processes of shards 1..N-1, each runs processTrainRequests on its own queues
+std::vector<pid_t> forkShardServers(int responseQueue, int logQueue, shared_mem_t *shm, Intersection *inter_ptr,
+    int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+
+#endif
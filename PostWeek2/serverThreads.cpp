@@ -0,0 +1,337 @@
+/*  Group G
+    Date: 4/28/2025
+    Program Description: Worker pool with work stealing, log thread and deadlock
+    detection thread for the threaded server.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <sys/msg.h>
+
+#include "serverThreads.h"
+#include "TrainCommunication.h"
+#include "trainCommExtension.h"
+#include "DeadlockDetection.h"
+#include "SimConfig.h"
+#include "Partitioner.h"
+#include "logRing.h"
+
+// log message type that tells the log thread to stop, train log messages are type 1
+static const long LOG_STOP = 3;
+
+// One worker's requests: the owner takes from the front, thieves take from the back
+struct WorkerDeque {
+    std::mutex lock;
+    std::deque<RequestMsg> requests;
+    long decided = 0;
+    long stolen = 0;
+};
+
+// State shared by the server thread and the worker, log and deadlock threads
+struct ThreadPool {
+    std::vector<WorkerDeque> deques;
+    std::vector<std::mutex> intersectionLocks;   // guards an intersection's held/waiting column and parked list
+    WaiterLists waiters;
+
+    std::mutex workLock;
+    std::condition_variable workReady;
+    long pending = 0;                            // requests in all deques, guarded by workLock
+    bool stopping = false;                       // guarded by workLock
+
+    ThreadPool(int workers, int num_intersections)
+        : deques(workers), intersectionLocks(num_intersections), waiters(num_intersections) {}
+};
+
+/* takeRequest gets the next request for worker w: its own deque first, then the back of another one */
+static bool takeRequest(ThreadPool& pool, int w, RequestMsg& req)
+{
+    {
+        std::lock_guard<std::mutex> own(pool.deques[w].lock);
+        if (!pool.deques[w].requests.empty())
+        {
+            req = pool.deques[w].requests.front();
+            pool.deques[w].requests.pop_front();
+            return true;
+        }
+    }
+
+    int workers = pool.deques.size();
+    for (int step = 1; step < workers; step++)
+    {
+        WorkerDeque& victim = pool.deques[(w + step) % workers];
+        std::lock_guard<std::mutex> theirs(victim.lock);
+        if (!victim.requests.empty())
+        {
+            req = victim.requests.back();
+            victim.requests.pop_back();
+            pool.deques[w].stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+* decideRequest decides one ACQUIRE, RELEASE or HANDOFF while holding the lock of the intersection
+* it touches. A HANDOFF takes its two locks one after the other, never both, so workers cannot
+* deadlock on each other. The held matrix, changed under the intersection lock, records which train
+* holds a Mutex intersection; its pthread mutex is not used here since another worker may release
+* it. Cycle checks for lookahead requests read other intersections' columns without their locks,
+* the deadlock thread catches what they miss.
+*/
+static void decideRequest(ThreadPool& pool, ServerBatch& batch, const RequestMsg& req, int waitQueue, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting)
+{
+    if (req.mtype == RequestType::HANDOFF)
+    {
+        serverStats.handoffs++;
+        serverQueueEvent(batch, EventType::SERVER_HANDED_OFF, req.train_id, req.intersection_id, req.release_id);
+    }
+    if (req.mtype == RequestType::RELEASE || req.mtype == RequestType::HANDOFF)
+    {
+        int releaseIdx = (req.mtype == RequestType::HANDOFF) ? req.release_id : req.intersection_id;
+        std::lock_guard<std::mutex> guard(pool.intersectionLocks[releaseIdx]);
+        serverHandleRelease(batch, req, pool.waiters, shm, inter_ptr, held, sem, mutex, waiting);
+    }
+    if (req.mtype == RequestType::ACQUIRE || req.mtype == RequestType::HANDOFF)
+    {
+        std::lock_guard<std::mutex> guard(pool.intersectionLocks[req.intersection_id]);
+        serverHandleAcquire(batch, req, waitQueue, pool.waiters, shm, inter_ptr, held, sem, mutex, waiting);
+    }
+}
+
+/* workerThread decides requests until the server stops and every deque is empty */
+static void workerThread(ThreadPool& pool, int w, int responseQueue, int waitQueue, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting)
+{
+    ServerBatch batch;
+    RequestMsg req;
+    while (true)
+    {
+        if (takeRequest(pool, w, req))
+        {
+            {
+                std::lock_guard<std::mutex> guard(pool.workLock);
+                pool.pending--;
+            }
+            decideRequest(pool, batch, req, waitQueue, shm, inter_ptr, held, sem, mutex, waiting);
+            serverFlushBatch(responseQueue, batch);
+            pool.deques[w].decided++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(pool.workLock);
+        if (pool.stopping && pool.pending == 0)
+        {
+            return;
+        }
+        pool.workReady.wait(guard, [&pool] { return pool.pending > 0 || pool.stopping; });
+    }
+}
+
+/*
+* logThread writes train log messages as they arrive: it blocks for one, then takes whatever
+* else is queued and writes it all at once. Asking for types <= LOG_STOP returns text and event
+* messages first, so the stop message is only seen after every train message queued before it. With log rings
+* it takes every ring's records every 10 ms instead, until the stop message is queued.
+*/
+static void logThread(int logQueue)
+{
+    LogMsg msg;
+    ServerBatch batch; // reused, so its buffers stop growing after the first few writes
+    if (logRingsActive())
+    {
+        // the trains write to their log rings, the queue only carries overflow and the stop message
+        bool stopping = false;
+        while (!stopping)
+        {
+            stopping = msgrcv(logQueue, &msg, sizeof(LogMsg) - sizeof(long), LOG_STOP, IPC_NOWAIT) != -1;
+            logRingDrain(batch);
+            // messages that found their ring full came over the queue, after the ring's
+            while (msgrcv(logQueue, &msg, sizeof(LogMsg) - sizeof(long), -LOG_EVENT, IPC_NOWAIT) != -1)
+            {
+                serverQueueLogMsg(batch, msg);
+            }
+            serverWriteLogs(batch);
+            if (!stopping)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        return;
+    }
+
+    while (true)
+    {
+        if (msgrcv(logQueue, &msg, sizeof(LogMsg) - sizeof(long), -LOG_STOP, 0) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "logThread [ERROR]: Failed to receive log message: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (msg.mtype == LOG_STOP)
+        {
+            return;
+        }
+
+        serverQueueLogMsg(batch, msg);
+        while (msgrcv(logQueue, &msg, sizeof(LogMsg) - sizeof(long), -LOG_EVENT, IPC_NOWAIT) != -1)
+        {
+            serverQueueLogMsg(batch, msg);
+        }
+        serverWriteLogs(batch);
+    }
+}
+
+/*
+* deadlockThread checks for a cycle every simConfig.deadlockTickMs. It holds every intersection
+* lock (in index order) while it looks, so it sees a consistent graph, and any capacity it frees
+* goes straight to the parked trains.
+*/
+static void deadlockThread(ThreadPool& pool, int responseQueue, shared_mem_t *shm, Intersection *inter_ptr,
+    int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting)
+{
+    std::vector<Intersection> intersections(inter_ptr, inter_ptr + shm->num_intersections);
+    ServerBatch batch;
+
+    std::unique_lock<std::mutex> guard(pool.workLock);
+    while (!pool.workReady.wait_for(guard, std::chrono::milliseconds(simConfig.deadlockTickMs), [&pool] { return pool.stopping; }))
+    {
+        guard.unlock();
+        {
+            std::vector<std::unique_lock<std::mutex>> all;
+            for (std::mutex& lock : pool.intersectionLocks)
+            {
+                all.emplace_back(lock);
+            }
+            DeadlockCycle cycle;
+            if (checkForDeadlock(shm, cycle))
+            {
+                if (logEnabled(LogCategory::DEADLOCK, LogLevel::INFO))
+                {
+                    serverQueueLog(batch, "SERVER: Deadlock detected! Cycle: " + formatCycle(cycle, inter_ptr));
+                }
+                breakDeadlock(shm, inter_ptr, cycle);
+                for (int i = 0; i < shm->num_intersections; i++)
+                {
+                    grantParkedRequests(pool.waiters, i, batch, shm, inter_ptr, sem, mutex, held, waiting);
+                }
+            }
+        }
+        serverFlushBatch(responseQueue, batch);
+        guard.lock();
+    }
+}
+
+/*
+* processTrainRequestsThreaded receives batches on the calling thread and spreads them over the
+* worker deques by intersection. DONE messages are counted here, so the server thread knows when
+* to stop receiving; workers finish what is queued before they exit.
+*/
+void processTrainRequestsThreaded(int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting)
+{
+    int workers = simConfig.threads;
+    ThreadPool pool(workers, shm->num_intersections);
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; w++)
+    {
+        threads.emplace_back(workerThread, std::ref(pool), w, responseQueue, waitQueue, shm, inter_ptr, held, sem, mutex, waiting);
+    }
+    std::thread logger(logThread, logQueue);
+    std::thread detector;
+    if (simConfig.deadlockTickMs > 0)
+    {
+        detector = std::thread(deadlockThread, std::ref(pool), responseQueue, shm, inter_ptr, held, sem, mutex, waiting);
+    }
+
+    std::vector<RequestMsg> reqs(simConfig.batchSize);
+    std::vector<char> trainDone(shm->num_trains, 0);
+    int trainsDone = 0;
+    ServerBatch batch;
+
+    while (trainsDone < shm->num_trains)
+    {
+        int received = serverReceiveRequests(requestQueue, reqs.data(), simConfig.batchSize, true);
+        if (received == 0)
+        {
+            std::cerr << "processTrainRequests [ERROR]: Failed to receive request." << std::endl;
+            continue;
+        }
+        // the blocking receive sampled the queues when it woke, before the batch was taken
+
+        int queued = 0;
+        for (int r = 0; r < received; r++)
+        {
+            const RequestMsg& req = reqs[r];
+            if (!serverValidRequest(req, shm))
+            {
+                continue;
+            }
+            if (req.mtype == RequestType::DONE)
+            {
+                if (!trainDone[req.train_id])
+                {
+                    trainDone[req.train_id] = 1;
+                    trainsDone++;
+                    serverQueueEvent(batch, EventType::SERVER_TRAIN_DONE, req.train_id, -1);
+                }
+                continue;
+            }
+            // same partition, same worker, unless someone idle steals it
+            int home = partitionOf(req.mtype == RequestType::HANDOFF ? req.release_id : req.intersection_id);
+            std::lock_guard<std::mutex> guard(pool.deques[home].lock);
+            pool.deques[home].requests.push_back(req);
+            queued++;
+        }
+        {
+            std::lock_guard<std::mutex> guard(pool.workLock);
+            pool.pending += queued;
+        }
+        pool.workReady.notify_all();
+        serverFlushBatch(responseQueue, batch);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pool.workLock);
+        pool.stopping = true;
+    }
+    pool.workReady.notify_all();
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+    if (detector.joinable())
+    {
+        detector.join();
+    }
+
+    // trains log before sending DONE, so the stop message is queued behind their last lines
+    LogMsg stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.mtype = LOG_STOP;
+    msgsnd(logQueue, &stop, sizeof(LogMsg) - sizeof(long), 0);
+    logger.join();
+
+    long decided = 0;
+    long stolen = 0;
+    for (WorkerDeque& d : pool.deques)
+    {
+        decided += d.decided;
+        stolen += d.stolen;
+    }
+    std::cout << "Worker threads: " << workers << ", " << decided << " requests decided, " << stolen << " stolen from another worker" << std::endl;
+}
@@ -0,0 +1,22 @@
+/*  Group G
+    Date: 4/28/2025
+    Program Description: Multi-threaded server. The server thread receives request
+    batches and hands them to a pool of worker threads, one request deque per
+    worker (chosen by the intersection partition, so intersections used together
+    tend to stay on one core).
+    Workers decide under a per-intersection lock and steal from the back of another
+    worker's deque when their own is empty. Train log messages and deadlock
+    detection run on their own threads.
+*/
+
+#ifndef SERVER_THREADS_H
+#define SERVER_THREADS_H
+
+#include "shared_Mem.h"
+#include "Resource_Allocation.h"
+
+// Threaded version of processTrainRequests, runs until every train has sent DONE
+void processTrainRequestsThreaded(int requestQueue, int responseQueue, int logQueue, int waitQueue, shared_mem_t *shm,
+    Intersection *inter_ptr, int *held, sem_t *sem, pthread_mutex_t *mutex, int *waiting);
+
+#endif
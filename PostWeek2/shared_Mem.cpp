@@ -14,11 +14,15 @@
 #include <unistd.h>
 #include <cstdio>
 #include <cstring>
+#include <cerrno>
 #include <iostream>
 
 
 #include "shared_Mem.h"
 #include "Resource_Allocation.h"
+#include "DeadlockDetection.h"
+
+const char *sharedMemoryName = "/sharedMemory";
 
 /* 
 * mem_setup sets up shared memory object. Num_mutex is the number of mutex objects needed
@@ -40,6 +44,13 @@ void *shared_Mem::mem_setup(int num_mutex, int num_sem, const int sem_values[],
     void *mem_ptr; // pointer to memory object
 
     int shm_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666); // creates memory object, set to read and write
+    if (shm_fd == -1 && errno == EEXIST)
+    {
+        // most likely left behind by a run that crashed before mem_close, replace it
+        std::cerr << "mem_setup: removing stale shared memory " << name << std::endl;
+        shm_unlink(name);
+        shm_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    }
     if (shm_fd == -1)
     {
         std::cerr << "mem_setup [ERROR]: shared memory not opened" << std::endl; // print out error if shared memory is not created
@@ -57,6 +68,14 @@ void *shared_Mem::mem_setup(int num_mutex, int num_sem, const int sem_values[],
     mem->num_trains = num_trains;
     mem->num_intersections = num_intersections;
     mem->simulatedTime = 0; 
+    memset(&mem->requestSend, 0, sizeof(mem->requestSend));
+    memset(&mem->logSend, 0, sizeof(mem->logSend));
+    memset(&mem->waitSend, 0, sizeof(mem->waitSend));
+    mem->logSampling = 0;
+    mem->logWindowStart = 0;
+    mem->logWindowLines = 0;
+    mem->logQuietNs = 0;
+    mem->logSampled = 0;
 
     char *mem_struct = reinterpret_cast<char *>(mem) + sizeof(shared_mem_t);
     int *sem_val_block = reinterpret_cast<int *>(mem_struct);
@@ -73,6 +92,7 @@ void *shared_Mem::mem_setup(int num_mutex, int num_sem, const int sem_values[],
     pthread_mutexattr_init(&attribute);
     pthread_mutexattr_setpshared(&attribute, PTHREAD_PROCESS_SHARED);
     pthread_mutex_init(&mem->rat_mutex, &attribute);
+    pthread_mutex_init(&mem->wait_mutex, &attribute);
 
     // initialize mutexes
     for (int i = 0; i < num_mutex; i++)
@@ -99,6 +119,7 @@ void *shared_Mem::mem_setup(int num_mutex, int num_sem, const int sem_values[],
     int *waiting = reinterpret_cast<int *>(held + (num_trains * num_intersections));
     // Initialize waiting matrix to 0
     memset(waiting, 0, num_trains * num_intersections * sizeof(int));
+    waitGraphReset(num_trains, num_intersections);
     
     return mem_ptr;
 }
@@ -17,21 +17,42 @@
 #include <semaphore.h>
 
 
+// Send-side accounting for one kind of message queue traffic, updated atomically by every process
+typedef struct {
+    long sends;         // messages sent
+    long fullEvents;    // sends that found the queue full
+    long blockedNs;     // time spent blocked in msgsnd after finding it full
+    long dropped;       // log messages dropped by the overflow policy
+    long spilled;       // log messages parked in a train's local spill buffer
+} ipc_counters_t;
+
 typedef struct {
     int num_mutex;
     int num_sem;
     int num_trains;
     int num_intersections;
-    int simulatedTime;
+    int simulatedTime;            // only changed with __atomic_fetch_add, read with __atomic_load_n
     pthread_mutex_t rat_mutex;
+    pthread_mutex_t wait_mutex;   // shard servers: cycle check and wait edge write are one step
+    ipc_counters_t requestSend;   // trains -> request queue
+    ipc_counters_t logSend;       // trains -> log queue
+    ipc_counters_t waitSend;      // server -> its own wait queue
+    int logSampling;              // 1 while wait events are summarized (--log-budget), set by the server
+    long logWindowStart;          // CLOCK_MONOTONIC ns the current --log-budget window started
+    long logWindowLines;          // log lines (logged or summarized) in that window
+    long logQuietNs;              // time the log has been under half the budget while sampling
+    long logSampled;              // wait events summarized instead of logged
     
 } shared_mem_t;
 
 
 
+// Name of the shared memory object, daemon workers give each of theirs a unique one
+extern const char *sharedMemoryName;
+
 class shared_Mem { 
 public:
-    const char *name = "/sharedMemory"; // Name for the shared memory object
+    const char *name = sharedMemoryName; // Name for the shared memory object
     void* mem_setup(int num_mutex, int num_sem,  const int sem_values[], int num_trains);
     void mem_close(void* ptr);
 };
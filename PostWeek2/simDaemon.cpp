@@ -0,0 +1,583 @@
+/*  Group G
+    Date: 4/29/2025
+    Program Description: Simulation daemon and job submitter. The daemon forks its
+    workers once; every worker creates its four message queues once and names its
+    shared memory segment after itself, then runs jobs back to back: change to the
+    scenario directory, parse the job's options, run the simulation, return the
+    summary. The daemon keeps a FIFO of jobs from all submitters and starts a new
+    worker if one dies.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "simDaemon.h"
+#include "SimConfig.h"
+#include "shared_Mem.h"
+#include "TrainCommunication.h"
+#include "queueTelemetry.h"
+
+// one pre-forked worker as seen by the daemon
+struct DaemonWorker {
+    pid_t pid = -1;
+    int fd = -1;              // daemon end of the worker's socketpair
+    bool busy = false;
+    int clientFd = -1;        // submitter waiting for the running job, -1 if it went away
+    DaemonJob job;
+};
+
+// job waiting for a free worker
+struct QueuedJob {
+    int clientFd;
+    DaemonJob job;
+};
+
+static volatile sig_atomic_t daemonStopping = 0;
+
+/* stopDaemon asks the daemon loop to finish, installed for SIGINT and SIGTERM */
+static void stopDaemon(int)
+{
+    daemonStopping = 1;
+}
+
+/* nowMs reads the monotonic clock in milliseconds */
+static long nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/* daemonAddress fills a Unix-domain socket address, false if the path does not fit */
+static bool daemonAddress(const char *path, struct sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        std::cerr << "daemonAddress [ERROR]: socket path too long: " << path << std::endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+/* refuseJob fills a result for a job that could not be run */
+static void refuseJob(const DaemonJob &job, DaemonResult &result, const char *reason)
+{
+    result.status = -1;
+    std::string line = std::string(job.dir) + ": " + reason;
+    snprintf(result.summary, sizeof(result.summary), "%s", line.c_str());
+}
+
+/* drainWorkerQueues throws away messages a previous job left in the worker's queues */
+static void drainWorkerQueues()
+{
+    struct {
+        long mtype;
+        char text[512];
+    } msg;
+    int queues[] = {requestQueue, responseQueue, logQueue, waitQueue};
+    int drained = 0;
+    for (int q : queues)
+    {
+        while (msgrcv(q, &msg, sizeof(msg.text), 0, IPC_NOWAIT | MSG_NOERROR) != -1)
+        {
+            drained++;
+        }
+    }
+    if (drained > 0)
+    {
+        std::cerr << "drainWorkerQueues: dropped " << drained << " messages left by the previous job" << std::endl;
+    }
+}
+
+/*
+* runDaemonJob runs one job in its scenario directory with the job's options. Console output of
+* the run goes to data/daemon.out next to data/simulation.log. The caller changes back afterwards.
+*/
+static void runDaemonJob(const DaemonJob &job, DaemonResult &result)
+{
+    // argv for parseSimConfig, the words outlive the run because simConfig points into them
+    std::vector<std::string> words;
+    std::istringstream ss(job.args);
+    std::string word;
+    while (ss >> word)
+    {
+        words.push_back(word);
+    }
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>("RailwaySim"));
+    for (std::string &w : words)
+    {
+        argv.push_back(&w[0]);
+    }
+    argv.push_back(nullptr);
+
+    simConfig = SimConfig();
+    if (!parseSimConfig(argv.size() - 1, argv.data()))
+    {
+        refuseJob(job, result, "invalid options");
+        return;
+    }
+    if (simConfig.daemonWorkers > 0 || simConfig.submitDir != nullptr || simConfig.clientTrain != nullptr
+        || simConfig.transport == Transport::SOCKET)
+    {
+        refuseJob(job, result, "--daemon, --submit, --client and --transport=socket are not allowed in a job");
+        simConfig = SimConfig();
+        return;
+    }
+    if (chdir(job.dir) == -1 || access("data/intersections.txt", R_OK) == -1 || access("data/trains.txt", R_OK) == -1)
+    {
+        refuseJob(job, result, "no readable data/intersections.txt and data/trains.txt");
+        simConfig = SimConfig();
+        return;
+    }
+
+    std::cout.flush();
+    fflush(stdout);
+    int savedOut = dup(STDOUT_FILENO);
+    int out = open("data/daemon.out", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out != -1)
+    {
+        dup2(out, STDOUT_FILENO);
+        close(out);
+    }
+
+    // everything a previous job in this process left behind
+    drainWorkerQueues();
+    trainNames.clear();
+    resetServerStats();
+    telemetryReset();
+
+    long start = nowMs();
+    result.status = runSimulation();
+    result.wallMs = nowMs() - start;
+
+    std::cout.flush();
+    fflush(stdout);
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedOut);
+
+    result.trains = trainNames.size();
+    result.completed = result.status == 0 ? result.trains - serverStats.abandoned : 0;
+    result.requests = serverStats.requests;
+    result.responses = serverStats.responses;
+    if (result.status == 0)
+    {
+        std::ostringstream line;
+        line << job.dir << ": " << result.completed << "/" << result.trains << " trains completed, " << result.requests << " requests, "
+             << result.responses << " responses, " << result.wallMs << " ms on worker " << result.worker;
+        snprintf(result.summary, sizeof(result.summary), "%s", line.str().c_str());
+    }
+    else
+    {
+        refuseJob(job, result, "simulation setup failed, see data/daemon.out");
+    }
+    simConfig = SimConfig();
+}
+
+/*
+* runWorker is the body of a pre-forked worker: create the queues once, then run every job the
+* daemon sends until the daemon closes its end. Never returns.
+*/
+static void runWorker(int worker, int fd)
+{
+    // the daemon handles Ctrl-C and lets a running job finish
+    setpgid(0, 0);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    // one segment name per worker so concurrent jobs never collide
+    static char shmName[64];
+    snprintf(shmName, sizeof(shmName), "/sharedMemory.%d", (int)getpid());
+    sharedMemoryName = shmName;
+
+    requestQueue = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+    responseQueue = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+    logQueue = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+    waitQueue = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+    int home = open(".", O_RDONLY | O_DIRECTORY);
+    if (requestQueue == -1 || responseQueue == -1 || logQueue == -1 || waitQueue == -1 || home == -1)
+    {
+        std::cerr << "runWorker [ERROR]: Worker " << worker << " could not set up: " << strerror(errno) << std::endl;
+        cleanupMessageQueues(requestQueue, responseQueue, logQueue, waitQueue);
+        exit(1);
+    }
+
+    DaemonJob job;
+    while (recv(fd, &job, sizeof(job), 0) == (ssize_t)sizeof(job))
+    {
+        job.dir[sizeof(job.dir) - 1] = '\0';
+        job.args[sizeof(job.args) - 1] = '\0';
+
+        DaemonResult result;
+        memset(&result, 0, sizeof(result));
+        result.worker = worker;
+        runDaemonJob(job, result);
+
+        // runSimulation installs its own SIGINT handler, the job is over
+        signal(SIGINT, SIG_DFL);
+        if (fchdir(home) == -1)
+        {
+            std::cerr << "runWorker [ERROR]: Worker " << worker << " lost its directory: " << strerror(errno) << std::endl;
+        }
+        send(fd, &result, sizeof(result), MSG_NOSIGNAL);
+    }
+
+    cleanupMessageQueues(requestQueue, responseQueue, logQueue, waitQueue);
+    exit(0);
+}
+
+/* startWorker forks worker w, the child closes every daemon descriptor it inherited */
+static bool startWorker(std::vector<DaemonWorker> &workers, int w, int listenFd, const std::vector<int> &clients)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        std::cerr << "startWorker [ERROR]: " << strerror(errno) << std::endl;
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        std::cerr << "startWorker [ERROR]: Fork failed: " << strerror(errno) << std::endl;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        close(listenFd);
+        for (const DaemonWorker &other : workers)
+        {
+            if (other.fd != -1)
+            {
+                close(other.fd);
+            }
+        }
+        for (int c : clients)
+        {
+            close(c);
+        }
+        runWorker(w, fds[1]);
+    }
+    close(fds[1]);
+    workers[w].pid = pid;
+    workers[w].fd = fds[0];
+    workers[w].busy = false;
+    workers[w].clientFd = -1;
+    return true;
+}
+
+/* replyToClient sends a result to a submitter, a submitter that went away is ignored */
+static void replyToClient(int clientFd, const DaemonResult &result)
+{
+    if (clientFd != -1)
+    {
+        send(clientFd, &result, sizeof(result), MSG_NOSIGNAL);
+    }
+}
+
+/*
+* runDaemon listens on simConfig.daemonSocket with simConfig.daemonWorkers pre-forked workers.
+* Jobs are queued in arrival order and started as soon as a worker is free, so with N workers up
+* to N scenarios run at once. Stops on SIGINT/SIGTERM after the running jobs finish.
+*/
+int runDaemon()
+{
+    const char *path = simConfig.daemonSocket;
+    struct sockaddr_un addr;
+    if (!daemonAddress(path, addr))
+    {
+        return 1;
+    }
+    int listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listenFd == -1)
+    {
+        std::cerr << "runDaemon [ERROR]: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    unlink(path);
+    if (bind(listenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1 || listen(listenFd, 128) == -1)
+    {
+        std::cerr << "runDaemon [ERROR]: Failed to listen on " << path << ": " << strerror(errno) << std::endl;
+        close(listenFd);
+        return 1;
+    }
+
+    std::vector<DaemonWorker> workers(simConfig.daemonWorkers);
+    std::vector<int> clients;
+    std::deque<QueuedJob> jobs;
+    for (int w = 0; w < (int)workers.size(); w++)
+    {
+        if (!startWorker(workers, w, listenFd, clients))
+        {
+            close(listenFd);
+            unlink(path);
+            return 1;
+        }
+    }
+
+    // no SA_RESTART, so poll returns when a stop signal arrives
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopDaemon;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::cout << "Daemon: listening on " << path << " with " << workers.size() << " workers" << std::endl;
+
+    while (!daemonStopping)
+    {
+        // hand queued jobs to free workers
+        for (DaemonWorker &worker : workers)
+        {
+            if (jobs.empty())
+            {
+                break;
+            }
+            if (worker.busy || worker.fd == -1)
+            {
+                continue;
+            }
+            worker.job = jobs.front().job;
+            worker.clientFd = jobs.front().clientFd;
+            jobs.pop_front();
+            worker.busy = true;
+            if (send(worker.fd, &worker.job, sizeof(worker.job), MSG_NOSIGNAL) == -1)
+            {
+                std::cerr << "runDaemon [ERROR]: Failed to send a job to worker " << (&worker - &workers[0]) << ": " << strerror(errno) << std::endl;
+            }
+        }
+
+        std::vector<struct pollfd> fds;
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const DaemonWorker &worker : workers)
+        {
+            fds.push_back({worker.fd, POLLIN, 0});
+        }
+        for (int c : clients)
+        {
+            fds.push_back({c, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) == -1)
+        {
+            if (errno != EINTR)
+            {
+                std::cerr << "runDaemon [ERROR]: poll failed: " << strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int c = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (c != -1)
+            {
+                clients.push_back(c);
+            }
+        }
+
+        // results, or a worker that died mid-job
+        for (size_t w = 0; w < workers.size(); w++)
+        {
+            DaemonWorker &worker = workers[w];
+            if (!(fds[1 + w].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            DaemonResult result;
+            if (recv(worker.fd, &result, sizeof(result), 0) == (ssize_t)sizeof(result))
+            {
+                result.summary[sizeof(result.summary) - 1] = '\0';
+                std::cout << "Daemon: " << result.summary << std::endl;
+                replyToClient(worker.clientFd, result);
+                worker.busy = false;
+                worker.clientFd = -1;
+                continue;
+            }
+
+            std::cerr << "runDaemon [ERROR]: Worker " << w << " (pid " << worker.pid << ") died, starting a new one" << std::endl;
+            close(worker.fd);
+            worker.fd = -1;
+            waitpid(worker.pid, nullptr, 0);
+            // its queues were private, its segment is named after it
+            char shmName[64];
+            snprintf(shmName, sizeof(shmName), "/sharedMemory.%d", (int)worker.pid);
+            shm_unlink(shmName);
+            if (worker.busy)
+            {
+                memset(&result, 0, sizeof(result));
+                result.worker = w;
+                refuseJob(worker.job, result, "worker died during the run");
+                replyToClient(worker.clientFd, result);
+            }
+            startWorker(workers, w, listenFd, clients);
+        }
+
+        // new jobs, or submitters that went away
+        for (size_t i = 1 + workers.size(); i < fds.size(); i++)
+        {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            int c = fds[i].fd;
+            QueuedJob queued;
+            queued.clientFd = c;
+            if (recv(c, &queued.job, sizeof(queued.job), 0) == (ssize_t)sizeof(queued.job))
+            {
+                queued.job.dir[sizeof(queued.job.dir) - 1] = '\0';
+                queued.job.args[sizeof(queued.job.args) - 1] = '\0';
+                jobs.push_back(queued);
+                std::cout << "Daemon: queued " << queued.job.dir << " [" << queued.job.args << "], " << jobs.size() << " waiting" << std::endl;
+                continue;
+            }
+
+            close(c);
+            for (auto it = clients.begin(); it != clients.end(); ++it)
+            {
+                if (*it == c)
+                {
+                    clients.erase(it);
+                    break;
+                }
+            }
+            for (auto it = jobs.begin(); it != jobs.end();)
+            {
+                it = (it->clientFd == c) ? jobs.erase(it) : it + 1;
+            }
+            // a running job finishes anyway, its result has nowhere to go
+            for (DaemonWorker &worker : workers)
+            {
+                if (worker.clientFd == c)
+                {
+                    worker.clientFd = -1;
+                }
+            }
+        }
+    }
+
+    std::cout << "Daemon: stopping, " << jobs.size() << " queued jobs dropped" << std::endl;
+    for (const QueuedJob &queued : jobs)
+    {
+        DaemonResult result;
+        memset(&result, 0, sizeof(result));
+        result.worker = -1;
+        refuseJob(queued.job, result, "daemon stopped before the job started");
+        replyToClient(queued.clientFd, result);
+    }
+
+    // idle workers see the closed socket and exit, busy ones finish their job first
+    for (DaemonWorker &worker : workers)
+    {
+        if (worker.fd == -1)
+        {
+            continue;
+        }
+        if (worker.busy)
+        {
+            DaemonResult result;
+            if (recv(worker.fd, &result, sizeof(result), 0) == (ssize_t)sizeof(result))
+            {
+                replyToClient(worker.clientFd, result);
+            }
+        }
+        close(worker.fd);
+        waitpid(worker.pid, nullptr, 0);
+    }
+    for (int c : clients)
+    {
+        close(c);
+    }
+    close(listenFd);
+    unlink(path);
+    return 0;
+}
+
+/*
+* submitDaemonJob sends simConfig.submitDir and every other option on the command line to the
+* daemon as one job, waits for its result and prints the summary. Option values are taken as
+* single words, and relative paths in them are relative to the scenario directory.
+* output: 0 if every train completed, 1 otherwise
+*/
+int submitDaemonJob(int argc, char *argv[])
+{
+    DaemonJob job;
+    memset(&job, 0, sizeof(job));
+
+    // the daemon runs in its own directory
+    char dir[PATH_MAX];
+    if (realpath(simConfig.submitDir, dir) == nullptr || strlen(dir) >= sizeof(job.dir))
+    {
+        std::cerr << "submitDaemonJob [ERROR]: Bad scenario directory " << simConfig.submitDir << std::endl;
+        return 1;
+    }
+    strcpy(job.dir, dir);
+
+    std::string args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--submit=", 9) == 0 || strncmp(argv[i], "--daemon-socket=", 16) == 0)
+        {
+            continue;
+        }
+        if (!args.empty())
+        {
+            args += ' ';
+        }
+        args += argv[i];
+    }
+    if (args.size() >= sizeof(job.args))
+    {
+        std::cerr << "submitDaemonJob [ERROR]: Options are longer than " << sizeof(job.args) - 1 << " characters" << std::endl;
+        return 1;
+    }
+    strcpy(job.args, args.c_str());
+
+    struct sockaddr_un addr;
+    if (!daemonAddress(simConfig.daemonSocket, addr))
+    {
+        return 1;
+    }
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1)
+    {
+        std::cerr << "submitDaemonJob [ERROR]: Failed to connect to " << simConfig.daemonSocket << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    DaemonResult result;
+    if (send(fd, &job, sizeof(job), 0) != (ssize_t)sizeof(job) || recv(fd, &result, sizeof(result), 0) != (ssize_t)sizeof(result))
+    {
+        std::cerr << "submitDaemonJob [ERROR]: No result from the daemon." << std::endl;
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    result.summary[sizeof(result.summary) - 1] = '\0';
+    std::cout << result.summary << std::endl;
+    return (result.status == 0 && result.completed == result.trains) ? 0 : 1;
+}
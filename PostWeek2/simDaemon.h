@@ -0,0 +1,51 @@
+/*  Group G
+    Date: 4/29/2025
+    Program Description: Long-lived simulation daemon. A sweep over many scenarios
+    pays for the shared memory segment, four message queues and a fresh process
+    on every run. The daemon pre-forks a pool of workers that each create their
+    queues once, then takes scenario jobs over a Unix-domain socket, queues them,
+    hands each one to a free worker (several run at once with more workers) and
+    sends the result summary back to whoever submitted it.
+*/
+
+#ifndef SIM_DAEMON_H
+#define SIM_DAEMON_H
+
+#include <cstdint>
+
+// longest scenario directory and option string a job can carry
+const int DAEMON_MAX_DIR = 256;
+const int DAEMON_MAX_ARGS = 512;
+
+// submitter -> daemon -> worker, one SOCK_SEQPACKET message
+struct DaemonJob {
+    char dir[DAEMON_MAX_DIR];      // absolute scenario directory, holds data/intersections.txt and data/trains.txt
+    char args[DAEMON_MAX_ARGS];    // simulation options for this job, separated by spaces
+};
+
+// worker -> daemon -> submitter, one SOCK_SEQPACKET message
+struct DaemonResult {
+    int32_t status;                // 0 if the simulation ran, -1 if the job was refused or failed to set up
+    int32_t worker;                // worker that ran it, -1 if none did
+    int32_t trains;
+    int32_t completed;             // trains that sent DONE (the rest exited without completing)
+    int64_t requests;
+    int64_t responses;
+    int64_t wallMs;                // setup, run and teardown on the worker
+    char summary[256];             // one line for the submitter
+};
+
+// Listen on simConfig.daemonSocket with simConfig.daemonWorkers workers until SIGINT/SIGTERM
+int runDaemon();
+
+// Send the scenario in simConfig.submitDir with the rest of argv as its options, print the summary
+int submitDaemonJob(int argc, char *argv[]);
+
+// main.cpp: one simulation in the current directory on the queues below
+int runSimulation();
+extern int requestQueue;
+extern int responseQueue;
+extern int logQueue;
+extern int waitQueue;
+
+#endif
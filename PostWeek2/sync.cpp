@@ -15,6 +15,8 @@
 #include "Resource_Allocation.h"
 #include "shared_Mem.h"
 #include "sync.h"
+#include "DeadlockDetection.h"
+#include "SimConfig.h"
 
 #include <iostream>
 
@@ -54,20 +56,21 @@ string checkIntersectionType(const char* intersectionID, Intersection *inter_ptr
 }
 
 /* addtoWaitMatrix adds a train at a given intersection to the wait matrix
-* input: shared memory pointer, intersection pointer, intersection ID, train ID, waiting matrix pointer
+* input: shared memory pointer, intersection pointer, intersection index, train index, waiting matrix pointer
 * output: returns true if the train was added to the wait matrix, false otherwise
 */
-bool addtoWaitMatrix(shared_mem_t *shm, Intersection *inter_ptr, const char* intersectionID, int trainID, int *waiting){
+bool addtoWaitMatrix(shared_mem_t *shm, Intersection *inter_ptr, int intersectionIdx, int trainIdx, int *waiting){
     bool added = false;
 
     // get intersection in shared memory
-    Intersection *intersection = findIntersectionbyID(intersectionID, inter_ptr, shm->num_intersections);
+    Intersection *intersection = &inter_ptr[intersectionIdx];
     
     // check if intersection is locked in shared memory
-    int waiting_num = waiting[trainID * shm->num_intersections + intersection->index];
+    int waiting_num = waiting[trainIdx * shm->num_intersections + intersection->index];
     if(waiting_num == 0){
         // if the intersection is 0 in the held matrix it is not locked
-        waiting[trainID * shm->num_intersections + intersection->index] = 1; // set held matrix to 1
+        waiting[trainIdx * shm->num_intersections + intersection->index] = 1; // set held matrix to 1
+        waitGraphWait(trainIdx, intersection->index);
         added = true;
     }
     
@@ -76,22 +79,22 @@ bool addtoWaitMatrix(shared_mem_t *shm, Intersection *inter_ptr, const char* int
         added = false;
     }
     else{ 
-        cerr << "addToWaitMatrix [ERROR]: Waiting matrix error at " << trainID << " " << intersectionID << "\nwaiting num: " << waiting_num << endl;
+        cerr << "addToWaitMatrix [ERROR]: Waiting matrix error at " << trainIdx << " " << intersection->name << "\nwaiting num: " << waiting_num << endl;
     }
 
     return added;
 }
 
 /*
-* intersectionOpen takes intersection ID reference as input performs 
+* intersectionOpen takes intersection index as input performs 
 * checks to see if intersection is open without changing lock status
 * returns true if intersection is open
 */
-bool checkIntersectionFull(shared_mem_t *shm, Intersection *inter_ptr, const char* intersectionID, int *held){
+bool checkIntersectionFull(shared_mem_t *shm, Intersection *inter_ptr, int intersectionIdx, int *held){
     bool full = false;
 
     // get intersection in shared memory
-    Intersection *intersection = findIntersectionbyID(intersectionID, inter_ptr, shm->num_intersections);
+    Intersection *intersection = &inter_ptr[intersectionIdx];
     // check if intersection is locked in shared memory
     
     int max = intersection->capacity;
@@ -115,17 +118,16 @@ bool checkIntersectionFull(shared_mem_t *shm, Intersection *inter_ptr, const cha
 
 /*
 * checkIntersectionLockbyTrain checks if the intersection is locked by a specific train
-* input: shared memory pointer, intersection pointer, intersection ID, train ID, and held matrix pointer
+* input: shared memory pointer, intersection pointer, intersection index, train index, and held matrix pointer
 * returns true if the intersection is locked by the train
 */
-bool checkIntersectionLockbyTrain(shared_mem_t *shm, Intersection *inter_ptr, const char* intersectionID, const char* trainID, int *held){
+bool checkIntersectionLockbyTrain(shared_mem_t *shm, Intersection *inter_ptr, int intersectionIdx, int trainIdx, int *held){
     bool locked = false;
-    int trainIDNum = stoi(string(trainID).substr(5)); // convert string to integer
     // get intersection in shared memory
-    Intersection *intersection = findIntersectionbyID(intersectionID, inter_ptr, shm->num_intersections);
+    Intersection *intersection = &inter_ptr[intersectionIdx];
     
     // check if intersection is locked in shared memory
-    int held_num = held[trainIDNum * shm->num_intersections + intersection->index];
+    int held_num = held[trainIdx * shm->num_intersections + intersection->index];
     if(held_num == 1){
         // if the intersection is 1 in the held matrix it is locked
         locked = true;
@@ -137,58 +139,69 @@ bool checkIntersectionLockbyTrain(shared_mem_t *shm, Intersection *inter_ptr, co
     }
 
     else{ 
-        cerr << "checkIntersectionLockbyTrain [ERROR]: Held matrix error at " << trainID << " " << intersectionID << "\nHeld Num: " << held_num << endl;
+        cerr << "checkIntersectionLockbyTrain [ERROR]: Held matrix error at " << trainIdx << " " << intersection->name << "\nHeld Num: " << held_num << endl;
     }
 
     return locked;
 }
 
+/*
+* usesIntersectionMutex tells if the pthread mutex of a Mutex intersection is locked for the train holding it.
+* With --threads one worker may lock it and another release it, which a pthread mutex does not allow, so
+* there the held matrix (changed under the worker's intersection lock) is the only record of the holder.
+*/
+static bool usesIntersectionMutex()
+{
+    return simConfig.threads <= 1;
+}
+
 /*
 * LockIntersection locks an intersection based on the type of lock
-* (semaphore or mutex) and adds the train ID to the held matrix
+* (semaphore or mutex) and adds the train index to the held matrix
 * input: shared memory pointer, intersection pointer, semaphore pointer, mutex pointer,
-* intersection ID, train ID, and held matrix pointer
+* intersection index, train index, and held matrix pointer
 * returns true if lock was able to be acquired
 */
-bool lockIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, const char* intersectionID, const char* trainID, int *held, int *waiting){
+bool lockIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int intersectionIdx, int trainIdx, int *held, int *waiting){
     bool locked = false; // set default to false to protect from errors
-    int trainIDNum = stoi(string(trainID).substr(5)); // convert string to integer
 
-    Intersection *intersection = findIntersectionbyID(intersectionID, inter_ptr, shm->num_intersections);
+    Intersection *intersection = &inter_ptr[intersectionIdx];
     
 
     // if intersection is unlocked check the type
     
-        string type = checkIntersectionType(intersectionID, inter_ptr, shm->num_intersections);
         // lock the intersection based on the lock type
 
-        if(type == "Semaphore"){
+        if(strcmp(intersection->type, "Semaphore") == 0){
             // lock semaphore
             sem_wait(&sem[intersection->sem_index]);
 
             // add train ID to intersection in resource allocation table
             pthread_mutex_lock(&shm->rat_mutex);
-            held[trainIDNum * shm->num_intersections + intersection->index] = 1; // set held matrix to 1
+            held[trainIdx * shm->num_intersections + intersection->index] = 1; // set held matrix to 1
             pthread_mutex_unlock(&shm->rat_mutex);
-            // std::cout << "train " << trainID << " Intersection " << intersectionID << " " << held[trainIDNum * shm->num_intersections + intersection->index] << std::endl;
-            waiting[trainIDNum * shm->num_intersections + intersection->index] = 0;
+            waiting[trainIdx * shm->num_intersections + intersection->index] = 0;
+            waitGraphHold(trainIdx, intersection->index);
             locked = true;
         }
 
-        else if(type == "Mutex"){
+        else if(strcmp(intersection->type, "Mutex") == 0){
             // lock mutex
-            pthread_mutex_lock(&mutex[intersection->mutex_index]);
+            if(usesIntersectionMutex()){
+                pthread_mutex_lock(&mutex[intersection->mutex_index]);
+            }
 
             // add train ID to intersection in resource allocation table
             pthread_mutex_lock(&shm->rat_mutex);
-            held[trainIDNum * shm->num_intersections + intersection->index] = 1; // set held matrix to 1
-            waiting[trainIDNum * shm->num_intersections + intersection->index] = 0; // set waiting matrix to 0
+            held[trainIdx * shm->num_intersections + intersection->index] = 1; // set held matrix to 1
+            waiting[trainIdx * shm->num_intersections + intersection->index] = 0; // set waiting matrix to 0
             pthread_mutex_unlock(&shm->rat_mutex);
+            waitGraphHold(trainIdx, intersection->index);
             locked = true;
         }
 
         else { // if intersection is invalid throw error
-            cerr << "lockIntersection [ERROR]: " << intersectionID << " invalid intersection type." << endl;
+            cerr << "lockIntersection [ERROR]: " << intersection->name << " invalid intersection type." << endl;
         }
 
     
@@ -198,42 +211,41 @@ bool lockIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pt
 
 
 /*
-* releaseIntersection takes intersection ID as input
+* releaseIntersection takes intersection index as input
 * unlocks semaphore or mutex
 * returns if lock was able to be released.
 */
-bool releaseIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, const char* intersectionID, const char* trainID, int *held){
-    int trainIDNum = stoi(string(trainID).substr(5)); // convert string to integer for held matrix
-
-    Intersection *intersection = findIntersectionbyID(intersectionID, inter_ptr, shm->num_intersections);
+bool releaseIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int intersectionIdx, int trainIdx, int *held){
+    Intersection *intersection = &inter_ptr[intersectionIdx];
     bool released = false; // default to false to decrease errors
 
-    if(checkIntersectionLockbyTrain(shm, inter_ptr, intersectionID, trainID, held)){
+    if(checkIntersectionLockbyTrain(shm, inter_ptr, intersectionIdx, trainIdx, held)){
         released = true; // set release flag to true
-        string type = checkIntersectionType(intersectionID, inter_ptr, shm->num_intersections);
         
         // lock the intersection based on the intersection/lock type
-        if(type == "Semaphore"){
+        if(strcmp(intersection->type, "Semaphore") == 0){
             // lock semaphore
             sem_post(&sem[intersection->sem_index]);
         }
 
-        else if(type == "Mutex"){
-            // lock mutex
-            pthread_mutex_unlock(&mutex[intersection->mutex_index]);
+        else if(strcmp(intersection->type, "Mutex") == 0){
+            // unlock mutex
+            if(usesIntersectionMutex()){
+                pthread_mutex_unlock(&mutex[intersection->mutex_index]);
+            }
         }
         else { // if intersection is invalid throw error
-            cerr << "releaseIntersection [ERROR]: " << intersectionID << "invalid intersection type." << endl;
+            cerr << "releaseIntersection [ERROR]: " << intersection->name << "invalid intersection type." << endl;
         }
 
         // remove train ID from intersection in resource allocation table and set to 0
         pthread_mutex_lock(&shm->rat_mutex);
-        held[trainIDNum * shm->num_intersections + intersection->index] = 0; // set held matrix to 0
+        held[trainIdx * shm->num_intersections + intersection->index] = 0; // set held matrix to 0
         pthread_mutex_unlock(&shm->rat_mutex);
+        waitGraphRelease(trainIdx, intersection->index);
     }
     
     // check intersection type
 
     return released;
 }
-
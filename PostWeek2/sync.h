@@ -27,14 +27,14 @@ Intersection* findIntersectionbyID(const char* intersectionID, Intersection *int
 
 string checkIntersectionType(const char* intersectionID, Intersection *inter_ptr, int num_intersections);
 
-bool checkIntersectionFull(shared_mem_t *shm, Intersection *inter_ptr, const char* intersectionID, int *held);
+bool checkIntersectionFull(shared_mem_t *shm, Intersection *inter_ptr, int intersectionIdx, int *held);
 
-bool checkIntersectionLockbyTrain(shared_mem_t *shm, Intersection *inter_ptr, const char* intersectionID, const char* trainID, int *held);
+bool checkIntersectionLockbyTrain(shared_mem_t *shm, Intersection *inter_ptr, int intersectionIdx, int trainIdx, int *held);
 
-bool addtoWaitMatrix(shared_mem_t *shm, Intersection *inter_ptr, const char* intersectionID, int trainID, int *waiting);
+bool addtoWaitMatrix(shared_mem_t *shm, Intersection *inter_ptr, int intersectionIdx, int trainIdx, int *waiting);
 
-bool lockIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, const char* intersectionID, const char* trainID, int *held, int *waiting);
+bool lockIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int intersectionIdx, int trainIdx, int *held, int *waiting);
 
-bool releaseIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, const char* intersectionID, const char* trainID, int *held);
+bool releaseIntersection(shared_mem_t *shm, Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int intersectionIdx, int trainIdx, int *held);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,350 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Builds the Chrome trace from the event records. The
+    records are put back in time order first (train and server records reach
+    the file in separate writes), then each train's spans and each
+    intersection's counters are replayed from its events.
+*/
+
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+#include "traceExport.h"
+
+// trace processes (pid), each holds one kind of track
+const int TRAIN_PID = 1;
+const int INTERSECTION_PID = 2;
+const int SERVER_PID = 3;
+
+// trace time (microseconds) per simulated time unit, and between events of the same unit
+const long TIME_UNIT_US = 1000000;
+const long EVENT_STEP_US = 1000;
+
+struct TraceRecord {
+    EventRecord event;
+    std::string text;   // TEXT records
+    long ts;            // trace time
+};
+
+// a server batch: the marker and the records written with it
+struct TraceBatch {
+    long start;
+    long end;
+    int responses;
+    int records;
+};
+
+// what a train is doing while its events are replayed, -1 when not started
+struct TrainState {
+    long waitStart = -1;
+    int waitIntersection = -1;
+    long crossStart = -1;
+    int crossIntersection = -1;
+    long freeSince = -1;    // released everything at this time, idle until the next request
+    std::vector<int> held;  // intersections granted by the server, for abandoned trains
+};
+
+/* TraceWriter writes trace events separated by commas and counts them */
+struct TraceWriter {
+    std::ostream& out;
+    long events = 0;
+
+    /* begin starts the next event object */
+    std::ostream& begin()
+    {
+        out << (events++ == 0 ? "\n" : ",\n");
+        return out;
+    }
+};
+
+/* quote writes text as a JSON string */
+static void quote(std::ostream& out, const char *text)
+{
+    out << '"';
+    for (const char *c = text; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            out << '\\' << *c;
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+            out << escaped;
+        }
+        else
+        {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+/* span writes a complete event ("X") from start to end, at least one microsecond long */
+static void span(TraceWriter& trace, const std::string& name, const char *category, long start, long end, int pid, int tid)
+{
+    std::ostream& out = trace.begin();
+    out << "{\"name\":";
+    quote(out, name.c_str());
+    out << ",\"cat\":\"" << category << "\",\"ph\":\"X\",\"ts\":" << start << ",\"dur\":" << std::max(end - start, 1L)
+        << ",\"pid\":" << pid << ",\"tid\":" << tid << "}";
+}
+
+/* instant writes an instant event ("i") on one track */
+static void instant(TraceWriter& trace, const char *name, const char *category, long ts, int pid, int tid)
+{
+    std::ostream& out = trace.begin();
+    out << "{\"name\":";
+    quote(out, name);
+    out << ",\"cat\":\"" << category << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << ts << ",\"pid\":" << pid << ",\"tid\":" << tid << "}";
+}
+
+/* counter writes an intersection's held and waiting trains ("C"), Perfetto gives each name a track */
+static void counter(TraceWriter& trace, const char *name, long ts, int held, int waiting)
+{
+    std::ostream& out = trace.begin();
+    out << "{\"name\":";
+    quote(out, name);
+    out << ",\"ph\":\"C\",\"ts\":" << ts << ",\"pid\":" << INTERSECTION_PID
+        << ",\"args\":{\"held\":" << held << ",\"waiting\":" << waiting << "}}";
+}
+
+/* metadata names a process or thread ("M") and fixes its position */
+static void metadata(TraceWriter& trace, const char *kind, const char *name, int pid, int tid)
+{
+    std::ostream& out = trace.begin();
+    out << "{\"name\":\"" << kind << "\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+    quote(out, name);
+    out << "}},\n{\"name\":\"" << (tid == 0 ? "process_sort_index" : "thread_sort_index") << "\",\"ph\":\"M\",\"pid\":" << pid
+        << ",\"tid\":" << tid << ",\"args\":{\"sort_index\":" << (tid == 0 ? pid : tid) << "}}";
+}
+
+/*
+* readRecords gives every record its trace time and collects the server batches. Records of the
+* same simulated time are EVENT_STEP_US apart in file order; a batch ends at its last record.
+*/
+static void readRecords(const char *data, size_t size, std::vector<TraceRecord>& records, std::vector<TraceBatch>& batches)
+{
+    std::unordered_map<int, long> perTime;
+    int batchLeft = 0;
+    size_t offset = 0;
+    while (offset + sizeof(EventRecord) <= size)
+    {
+        TraceRecord record;
+        memcpy(&record.event, data + offset, sizeof(EventRecord));
+        offset += sizeof(EventRecord);
+        int raw = 1;
+        if (record.event.type == EventType::TEXT)
+        {
+            size_t bytes = record.event.arg * sizeof(EventRecord);
+            if (offset + bytes > size)
+            {
+                break;
+            }
+            record.text.assign(data + offset, std::min<size_t>(record.event.other < 0 ? 0 : record.event.other, bytes));
+            offset += bytes;
+            raw += record.event.arg;
+        }
+        long step = std::min(perTime[record.event.time]++, TIME_UNIT_US / EVENT_STEP_US - 1);
+        record.ts = record.event.time * TIME_UNIT_US + step * EVENT_STEP_US;
+
+        if (record.event.type == EventType::SERVER_BATCH)
+        {
+            batches.push_back(TraceBatch{record.ts, record.ts, record.event.arg, 0});
+            batchLeft = record.event.other;
+            continue;
+        }
+        if (batchLeft > 0)
+        {
+            batches.back().end = std::max(batches.back().end, record.ts);
+            batches.back().records++;
+            batchLeft -= raw;
+        }
+        records.push_back(std::move(record));
+    }
+    std::stable_sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) { return a.ts < b.ts; });
+}
+
+/*
+* writeChromeTrace replays the records. A train waits from its ACQUIRE (or HANDOFF) until it has
+* acquired the intersection (or was denied it), crosses until it releases or hands it off, and is
+* idle between a RELEASE and its next request. Intersection counters follow the server's grants,
+* waits and releases.
+*/
+long writeChromeTrace(const char *data, size_t size, int numTrains, int numIntersections,
+    NameLookup train, NameLookup intersection, std::ostream& out)
+{
+    std::vector<TraceRecord> records;
+    std::vector<TraceBatch> batches;
+    readRecords(data, size, records, batches);
+
+    TraceWriter trace{out};
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    metadata(trace, "process_name", "Trains", TRAIN_PID, 0);
+    metadata(trace, "process_name", "Intersections", INTERSECTION_PID, 0);
+    metadata(trace, "process_name", "Server", SERVER_PID, 0);
+    for (int t = 0; t < numTrains; t++)
+    {
+        metadata(trace, "thread_name", train(t), TRAIN_PID, 2 * t + 1);
+        metadata(trace, "thread_name", (std::string(train(t)) + " waiting").c_str(), TRAIN_PID, 2 * t + 2);
+    }
+    metadata(trace, "thread_name", "Decisions", SERVER_PID, 1);
+
+    std::vector<int> held(numIntersections, 0);
+    std::vector<int> waiting(numIntersections, 0);
+    for (int i = 0; i < numIntersections; i++)
+    {
+        counter(trace, intersection(i), 0, 0, 0);
+    }
+    std::set<std::pair<int, int>> waitingTrains;   // (train, intersection)
+    std::vector<TrainState> trains(numTrains);
+
+    for (const TraceBatch& batch : batches)
+    {
+        std::ostream& o = trace.begin();
+        o << "{\"name\":\"batch\",\"cat\":\"server\",\"ph\":\"X\",\"ts\":" << batch.start << ",\"dur\":" << batch.end - batch.start + EVENT_STEP_US
+          << ",\"pid\":" << SERVER_PID << ",\"tid\":1,\"args\":{\"responses\":" << batch.responses << ",\"records\":" << batch.records << "}}";
+    }
+
+    for (const TraceRecord& record : records)
+    {
+        const EventRecord& e = record.event;
+        long ts = record.ts;
+        if (e.type == EventType::TEXT)
+        {
+            instant(trace, record.text.c_str(), "server", ts, SERVER_PID, 1);
+            continue;
+        }
+        if (e.train < 0 || e.train >= numTrains)
+        {
+            continue;
+        }
+        TrainState& state = trains[e.train];
+        int tid = 2 * e.train + 1;
+        bool validIntersection = e.intersection >= 0 && e.intersection < numIntersections;
+        std::string name = intersection(e.intersection);
+
+        // the crossing of state.crossIntersection ends at ts
+        auto endCrossing = [&]() {
+            if (state.crossStart >= 0)
+            {
+                span(trace, std::string("cross ") + intersection(state.crossIntersection), "crossing", state.crossStart, ts, TRAIN_PID, tid);
+                state.crossStart = -1;
+            }
+        };
+
+        switch (e.type)
+        {
+        case EventType::TRAIN_SENT_ACQUIRE:
+        case EventType::TRAIN_SENT_LOOKAHEAD:
+            if (state.crossStart < 0 && state.freeSince >= 0)
+            {
+                span(trace, "idle", "idle", state.freeSince, ts, TRAIN_PID, tid);
+            }
+            state.freeSince = -1;
+            if (state.waitStart < 0)
+            {
+                state.waitStart = ts;
+                state.waitIntersection = e.intersection;
+            }
+            break;
+        case EventType::TRAIN_SENT_HANDOFF:
+            endCrossing();
+            state.waitStart = ts;
+            state.waitIntersection = e.intersection;
+            break;
+        case EventType::TRAIN_ACQUIRED:
+        case EventType::TRAIN_DENIED:
+            if (state.waitStart >= 0)
+            {
+                span(trace, std::string(e.type == EventType::TRAIN_ACQUIRED ? "wait " : "denied ") + name, "waiting",
+                    state.waitStart, ts, TRAIN_PID, tid + 1);
+                state.waitStart = -1;
+            }
+            if (e.type == EventType::TRAIN_ACQUIRED)
+            {
+                state.crossStart = ts;
+                state.crossIntersection = e.intersection;
+            }
+            break;
+        case EventType::TRAIN_SENT_RELEASE:
+            endCrossing();
+            state.freeSince = ts;
+            break;
+        case EventType::TRAIN_COMPLETED:
+            endCrossing();
+            state.freeSince = -1;
+            instant(trace, "completed route", "train", ts, TRAIN_PID, tid);
+            break;
+        case EventType::SERVER_GRANTED:
+            if (validIntersection)
+            {
+                held[e.intersection]++;
+                state.held.push_back(e.intersection);
+                if (waitingTrains.erase({e.train, e.intersection}) > 0)
+                {
+                    waiting[e.intersection]--;
+                }
+                counter(trace, name.c_str(), ts, held[e.intersection], waiting[e.intersection]);
+            }
+            break;
+        case EventType::SERVER_QUEUED:
+        case EventType::SERVER_PARKED:
+            if (validIntersection && waitingTrains.insert({e.train, e.intersection}).second)
+            {
+                waiting[e.intersection]++;
+                counter(trace, name.c_str(), ts, held[e.intersection], waiting[e.intersection]);
+            }
+            break;
+        case EventType::SERVER_RELEASED:
+        case EventType::DEADLOCK_PREEMPTED:
+        {
+            auto found = std::find(state.held.begin(), state.held.end(), e.intersection);
+            if (found != state.held.end())
+            {
+                state.held.erase(found);
+                held[e.intersection]--;
+                counter(trace, name.c_str(), ts, held[e.intersection], waiting[e.intersection]);
+            }
+            if (e.type == EventType::DEADLOCK_PREEMPTED)
+            {
+                instant(trace, (std::string("preempted ") + train(e.train) + " from " + name).c_str(), "deadlock", ts, SERVER_PID, 1);
+            }
+            break;
+        }
+        case EventType::SERVER_ABANDONED:
+            for (int i : state.held)
+            {
+                held[i]--;
+                counter(trace, intersection(i), ts, held[i], waiting[i]);
+            }
+            state.held.clear();
+            for (auto w = waitingTrains.begin(); w != waitingTrains.end();)
+            {
+                if (w->first == e.train)
+                {
+                    waiting[w->second]--;
+                    counter(trace, intersection(w->second), ts, held[w->second], waiting[w->second]);
+                    w = waitingTrains.erase(w);
+                }
+                else
+                {
+                    w++;
+                }
+            }
+            instant(trace, (std::string(train(e.train)) + " abandoned").c_str(), "server", ts, SERVER_PID, 1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    out << "\n]}\n";
+    return trace.events;
+}
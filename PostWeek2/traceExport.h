@@ -0,0 +1,24 @@
+/*  Group G
+    Date: 4/30/2025
+    Program Description: Chrome trace-event JSON export of a binary event log,
+    for Perfetto (ui.perfetto.dev) or chrome://tracing. Every train gets a track
+    with its crossing and idle spans and one with its waiting spans, every
+    intersection gets held/waiting counters, and the server gets a span per
+    batch of decisions. One simulated time unit (one second in simulation.log)
+    is one second of trace time; events of the same time unit are spread over it
+    in log order so they do not collapse into one point.
+*/
+
+#ifndef TRACE_EXPORT_H
+#define TRACE_EXPORT_H
+
+#include <cstddef>
+#include <ostream>
+
+#include "eventLog.h"
+
+// Write the records in data (as after the file header) as a trace, returns the number of trace events
+long writeChromeTrace(const char *data, size_t size, int numTrains, int numIntersections,
+    NameLookup train, NameLookup intersection, std::ostream& out);
+
+#endif
@@ -14,111 +14,152 @@
 #include "shared_Mem.h"
 #include "trainCommExtension.h"
 #include "TrainCommunication.h"
+#include "logRing.h"
+#include "queueTelemetry.h"
 
 
 
 /* Function to send a DONE message keeping process running in main until all train are done
-*  this function takes a requestQueue and a char buffer as input. The requestQueue is a queue that holds the
-*  request messages, and the char buffer is where the request message will be copied to.
+*  this function takes a requestQueue and the train index as input. The requestQueue is a queue that holds the
+*  request messages.
 *  this function returns a bool that indicates if the DONE message was sent. 
 */
-bool trainSendDoneMsg(int requestQueue, const char* trainId){
+bool trainSendDoneMsg(int requestQueue, int trainIdx){
     RequestMsg msg;
         
         msg.mtype = RequestType::DONE;
-        // copy train ID to request message
-        strncpy(msg.train_id, trainId, sizeof(msg.train_id) - 1);
-        msg.train_id[sizeof(msg.train_id) - 1] = '\0';
+        msg.train_id = trainIdx;
+        msg.intersection_id = -1; // DONE is not for an intersection
+        msg.release_id = -1;
+        msg.flags = 0;
+        msg.seq = 0;
         
         // Send DONE message to the server
-        if (msgsnd(requestQueue, &msg, sizeof(msg) - sizeof(long), 0) == -1) {
+        if (!trainSendRequest(requestQueue, msg)) {
             std::cerr << "Failed to send DONE message: " << strerror(errno) << std::endl;
             return false;
         }
         return true;
 }
 
-/* function to have the server receive a log message and copy it to the log char buffer
-*  this function takes a logQueue and a char buffer as input. The logQueue is a queue that holds the 
-*  log messages, and the char buffer is where the log message will be copied to.
-*  the function returns a bool that indicates if the server received the log message.
+/* function to have the server drain every log message that is waiting in the log rings and the log queue without blocking
+*  this function takes a logQueue as input. The logQueue is a queue that holds the log messages.
+*  all drained messages are timestamped and written to the log with a single write.
+*  the function returns the number of log messages received.
 */
-bool serverReceiveLog(int logQueue, char* log) { 
+int serverDrainLogs(int logQueue) { 
     LogMsg logMsg;
+    static ServerBatch batch; // keeps its buffers' capacity from one drain to the next
 
-    // Receive log message
-    if (msgrcv(logQueue, &logMsg, sizeof(LogMsg) - sizeof(long), 0, 0) == -1) {
-        if(errno == EINTR) {
-            // Interrupted by signal
-            return false;
-        }
-        std::cerr << "serverReceiveLog [ERROR]: Failed to receive log message: " << strerror(errno) << std::endl;
-        return false;
+    // trains with a log ring never use the queue, take all of their records in one pass
+    int received = logRingDrain(batch);
+
+    // Receive log messages until the queue is empty
+    while (msgrcv(logQueue, &logMsg, sizeof(LogMsg) - sizeof(long), 0, IPC_NOWAIT) != -1) {
+        serverQueueLogMsg(batch, logMsg);
+        received++;
     }
-    // copy the log message to the char buffer
-    // **DEBUG** std::cout << "Received log message of length: " << strlen(logMsg.message) << std::endl;
-    // **DEBUG** std::cout << "Debug at serverReceiveLog : " << logMsg.message << std::endl;
-    strncpy(log, logMsg.message, sizeof(logMsg.message) - 1);
-    log[sizeof(logMsg.message) - 1] = '\0';
-    
-    logMessage(logMsg.message); 
-    return true;
+    if(errno != ENOMSG && errno != EINTR) {
+        std::cerr << "serverDrainLogs [ERROR]: Failed to receive log message: " << strerror(errno) << std::endl;
+    }
+
+    serverWriteLogs(batch);
+    return received;
 }
 
+/* function to add a message received on the log queue to a batch: a text line, or an event record
+*  when its type is LOG_EVENT.
+*/
+void serverQueueLogMsg(ServerBatch& batch, const LogMsg& msg) {
+    if (msg.mtype == LOG_EVENT) {
+        serverQueueEventRecord(batch, msg.message, sizeof(EventRecord));
+        return;
+    }
+    serverQueueLog(batch, msg.message, strnlen(msg.message, sizeof(msg.message)));
+}
 
-/* function to add a train to the wait queue and give the intersection ID of the intersection 
+
+/* function to add a train to the wait queue and give the intersection index of the intersection 
 *  that the train is waiting for. 
-*  this function takes the waitQueue, the train ID and the intersection ID as input.
+*  this function takes the waitQueue, the train index, the intersection index and the request sequence number as input.
 *  it returns a bool that indicates if the message was sent. 
 */
-bool addToWaitQueue(int waitQueue, const char* trainId, const char* intersectionId, shared_mem_t *shm, Intersection *inter_ptr, int *waiting) {
+bool addToWaitQueue(int waitQueue, int trainIdx, int intersectionIdx, uint32_t seq, shared_mem_t *shm, Intersection *inter_ptr, int *waiting) {
     WaitQueueMsg waitMsg;
 
-    std::string tempID = std::string(trainId);
-    long trainIdLong = std::stol(tempID.substr(5));
-
-    waitMsg.mtype = trainIdLong; 
-    // copy train ID and intersection ID to wait message
-    strncpy(waitMsg.train_id, trainId, sizeof(waitMsg.train_id) - 1);
-    waitMsg.train_id[sizeof(waitMsg.train_id) - 1] = '\0';
-
-    strncpy(waitMsg.intersection_id, intersectionId, sizeof(waitMsg.intersection_id) - 1);  
-    waitMsg.intersection_id[sizeof(waitMsg.intersection_id) - 1] = '\0';
+    waitMsg.mtype = trainIdx + 1; // mtype must be greater than 0
+    waitMsg.train_id = trainIdx;
+    waitMsg.intersection_id = intersectionIdx;
+    waitMsg.flags = 0;
+    waitMsg.seq = seq;
 
-    // TO DO: add train to wait matrix
-    addtoWaitMatrix(shm, inter_ptr, intersectionId, int(trainIdLong), waiting);
+    // add train to wait matrix
+    addtoWaitMatrix(shm, inter_ptr, intersectionIdx, trainIdx, waiting);
 
-    // send the wait message to the wait queue
-    if(msgsnd(waitQueue, &waitMsg, sizeof(waitMsg) - sizeof(long), 0) == -1) {
-        std::cerr << "addToWaitQueue [ERROR]: Failed to add to wait queue" << std::endl;
+    // send the wait message to the wait queue, the server must not block on its own queue
+    if(!sendWaitEntry(waitQueue, waitMsg, &shm->waitSend)) {
+        std::cerr << "addToWaitQueue [ERROR]: Failed to add to wait queue: " << strerror(errno) << std::endl;
         return false;
     } 
 
     return true;
 }
 
-/* function to receive wait message from the wait queue. Copies the train ID and intersection ID to the char buffer
-* this functions takes the waitQueue, the train ID and the intersection ID as input.
+/* function to receive wait message from the wait queue. Copies the train index, intersection index and 
+* sequence number to the output parameters.
 * it returns a bool that indicates if the wait message was received.
 */
-bool processWaitQueue(int waitQueue, char* trainId, char* intersectionId) {
+bool processWaitQueue(int waitQueue, int& trainIdx, int& intersectionIdx, uint32_t& seq) {
     WaitQueueMsg waitMsg;
 
     // Receive wait message
     if (msgrcv(waitQueue, &waitMsg, sizeof(waitMsg) - sizeof(long), 0, IPC_NOWAIT) == -1) {
         if (errno != ENOMSG) {
             std::cerr << "processWaitQueue [ERROR]: Failed to receive wait message: " << strerror(errno) << std::endl;
+            return false;
+        }
+        // entries spilled while the queue was full come after everything that was queued
+        if (!takeSpilledWait(waitMsg)) {
+            return false;
         }
-        return false;
     }
 
-    // Copy train ID and intersection ID to the char buffer
-    strncpy(trainId, waitMsg.train_id, sizeof(waitMsg.train_id) - 1);
-    trainId[sizeof(waitMsg.train_id) - 1] = '\0';
-
-    strncpy(intersectionId, waitMsg.intersection_id, sizeof(waitMsg.intersection_id) - 1);
-    intersectionId[sizeof(waitMsg.intersection_id) - 1] = '\0';
+    trainIdx = waitMsg.train_id;
+    intersectionIdx = waitMsg.intersection_id;
+    seq = waitMsg.seq;
 
     return true; // wait message was received
 }
 
+/* function to park an ACQUIRE on the server in deferred-grant mode. The train is added to the wait matrix
+*  and to the waiter list of the intersection, no response is sent until the intersection frees up.
+*  this function takes the waiter lists, the train index, the intersection index and the request sequence number as input.
+*/
+void parkRequest(WaiterLists& waiters, int trainIdx, int intersectionIdx, uint32_t seq, shared_mem_t *shm, Intersection *inter_ptr, int *waiting) {
+    ParkedRequest parked;
+    parked.train_id = trainIdx;
+    parked.seq = seq;
+
+    addtoWaitMatrix(shm, inter_ptr, intersectionIdx, trainIdx, waiting);
+    waiters[intersectionIdx].push_back(parked);
+}
+
+/* function to hand a freed intersection to the trains parked on it, in arrival order. Each parked train
+*  gets exactly one GRANT, added to the server batch. Called after releaseIntersection in deferred-grant mode.
+*  it returns the number of parked trains that were granted the intersection.
+*/
+int grantParkedRequests(WaiterLists& waiters, int intersectionIdx, ServerBatch& batch, shared_mem_t *shm, 
+    Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int *held, int *waiting) {
+    int granted = 0;
+    std::deque<ParkedRequest>& parked = waiters[intersectionIdx];
+
+    while (!parked.empty() && !checkIntersectionFull(shm, inter_ptr, intersectionIdx, held)) {
+        ParkedRequest next = parked.front();
+        parked.pop_front();
+
+        serverQueueResponse(batch, next.train_id, intersectionIdx, ResponseType::GRANT, next.seq);
+        lockIntersection(shm, inter_ptr, sem, mutex, intersectionIdx, next.train_id, held, waiting);
+        granted++;
+    }
+    return granted;
+}
@@ -22,20 +22,31 @@ struct LogMsg {
     char message[100];
 };
 
+// LogMsg types: text lines are type 1, LOG_EVENT carries an EventRecord in message (--log-format=binary)
+const long LOG_EVENT = 2;
+
 struct WaitQueueMsg {
-    long mtype; 
-    char train_id[20]; 
-    char intersection_id[20];
+    long mtype;                  // train index + 1
+    int32_t train_id;            // Train index
+    int16_t intersection_id;     // Intersection index the train is waiting for
+    uint16_t flags;              // reserved, 0
+    uint32_t seq;                // sequence number of the waiting ACQUIRE
 };
 
 
+bool trainSendDoneMsg(int requestQueue, int trainIdx);
+
+int serverDrainLogs(int logQueue);
+
+void serverQueueLogMsg(ServerBatch& batch, const LogMsg& msg);
 
-bool trainSendDoneMsg(int requestQueue, const char* trainId);
+bool addToWaitQueue(int waitQueue, int trainIdx, int intersectionIdx, uint32_t seq, shared_mem_t *shm, Intersection *inter_ptr, int *waiting);
 
-bool serverReceiveLog(int logQueue, char* log);
+bool processWaitQueue(int waitQueue, int& trainIdx, int& intersectionIdx, uint32_t& seq);
 
-bool addToWaitQueue(int waitQueue, const char* trainId, const char* intersectionId, shared_mem_t *shm, Intersection *inter_ptr, int *waiting);
+void parkRequest(WaiterLists& waiters, int trainIdx, int intersectionIdx, uint32_t seq, shared_mem_t *shm, Intersection *inter_ptr, int *waiting);
 
-bool processWaitQueue(int waitQueue,  char* trainId, char* intersectionId);
+int grantParkedRequests(WaiterLists& waiters, int intersectionIdx, ServerBatch& batch, shared_mem_t *shm, 
+    Intersection *inter_ptr, sem_t *sem, pthread_mutex_t *mutex, int *held, int *waiting);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+/*  Group G
+    Date: 4/24/2025
+    Program Description: Per-train mailbox slots with a ready-bitmap doorbell.
+    A train writes its request into its slot and sets its bit; the server scans
+    the bitmap a word at a time with find-first-set and services every set slot
+    in one pass.
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+
+#include "trainMailbox.h"
+#include "serverEventLoop.h"
+#include "queueTelemetry.h"
+
+// mapping shared by the server and the trains, inherited through fork
+static MailboxHeader *mailbox = nullptr;
+
+/* ready bitmap follows the header */
+static uint64_t *readyBits()
+{
+    return reinterpret_cast<uint64_t *>(mailbox + 1);
+}
+
+/* train slots follow the bitmap, cache line aligned */
+static MailboxSlot *mailboxSlot(int trainIdx)
+{
+    size_t offset = sizeof(MailboxHeader) + mailbox->num_words * sizeof(uint64_t);
+    offset = (offset + alignof(MailboxSlot) - 1) & ~(alignof(MailboxSlot) - 1);
+    return reinterpret_cast<MailboxSlot *>(reinterpret_cast<char *>(mailbox) + offset) + trainIdx;
+}
+
+/* waitSem waits on a semaphore, retrying when interrupted by a signal */
+static bool waitSem(sem_t *sem)
+{
+    while (sem_wait(sem) == -1)
+    {
+        if (errno != EINTR)
+        {
+            std::cerr << "mailbox [ERROR]: sem_wait: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+* mailboxSetup maps the header, the ready bitmap and one slot per train
+* input: number of trains
+* output: returns false if the mapping could not be created
+*/
+bool mailboxSetup(int num_trains)
+{
+    int num_words = (num_trains + 63) / 64;
+    size_t length = sizeof(MailboxHeader) + num_words * sizeof(uint64_t) + alignof(MailboxSlot)
+                    + num_trains * sizeof(MailboxSlot);
+
+    void *ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        std::cerr << "mailboxSetup [ERROR]: " << strerror(errno) << std::endl;
+        return false;
+    }
+    memset(ptr, 0, length);
+
+    mailbox = static_cast<MailboxHeader *>(ptr);
+    mailbox->num_trains = num_trains;
+    mailbox->num_words = num_words;
+    mailbox->length = length;
+    sem_init(&mailbox->doorbell, 1, 0);
+
+    for (int t = 0; t < num_trains; t++)
+    {
+        MailboxSlot *slot = mailboxSlot(t);
+        sem_init(&slot->slotFree, 1, 1);
+        sem_init(&slot->responsesReady, 1, 0);
+    }
+    return true;
+}
+
+/* mailboxClose destroys the semaphores and unmaps the mailboxes */
+void mailboxClose()
+{
+    if (mailbox == nullptr)
+    {
+        return;
+    }
+    for (int t = 0; t < mailbox->num_trains; t++)
+    {
+        sem_destroy(&mailboxSlot(t)->slotFree);
+        sem_destroy(&mailboxSlot(t)->responsesReady);
+    }
+    sem_destroy(&mailbox->doorbell);
+    munmap(mailbox, mailbox->length);
+    mailbox = nullptr;
+}
+
+/*
+* mailboxSendRequest writes the request into the train's slot and sets its ready bit.
+* Waits first if the server has not taken the previous request yet.
+*/
+bool mailboxSendRequest(const RequestMsg& req)
+{
+    MailboxSlot *slot = mailboxSlot(req.train_id);
+    if (!waitSem(&slot->slotFree))
+    {
+        return false;
+    }
+    slot->request = req;
+
+    uint64_t bit = 1ULL << (req.train_id % 64);
+    __atomic_fetch_or(&readyBits()[req.train_id / 64], bit, __ATOMIC_RELEASE);
+
+    // with the event loop the eventfd wakes the server, otherwise the mailbox doorbell does
+    if (requestDoorbell != -1)
+    {
+        ringDoorbell(requestDoorbell);
+    }
+    else
+    {
+        sem_post(&mailbox->doorbell);
+    }
+    return true;
+}
+
+/* mailboxReceiveResponse waits for the next response in the train's ring */
+bool mailboxReceiveResponse(int trainIdx, ResponseMsg& resp)
+{
+    MailboxSlot *slot = mailboxSlot(trainIdx);
+    if (!waitSem(&slot->responsesReady))
+    {
+        return false;
+    }
+    uint32_t read = slot->responseRead;
+    resp = slot->responses[read % MAILBOX_RESPONSES];
+    __atomic_store_n(&slot->responseRead, read + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+* mailboxReceiveRequests scans the ready bitmap and takes the request of every set slot,
+* up to maxRequests. If block is set it waits on the doorbell until at least one is taken.
+* output: returns the number of requests taken
+*/
+int mailboxReceiveRequests(RequestMsg* reqs, int maxRequests, bool block)
+{
+    uint64_t *ready = readyBits();
+    int received = 0;
+
+    do
+    {
+        if (block && !waitSem(&mailbox->doorbell))
+        {
+            return 0;
+        }
+        if (block)
+        {
+            // sample on wake-up, before the scan takes the pending requests
+            sampleQueueDepths();
+        }
+
+        for (int w = 0; w < mailbox->num_words && received < maxRequests; w++)
+        {
+            uint64_t bits = __atomic_load_n(&ready[w], __ATOMIC_ACQUIRE);
+            while (bits != 0 && received < maxRequests)
+            {
+                int b = __builtin_ctzll(bits);
+                bits &= bits - 1;
+
+                int trainIdx = w * 64 + b;
+                MailboxSlot *slot = mailboxSlot(trainIdx);
+                reqs[received++] = slot->request;
+
+                // clear the bit before freeing the slot, the next request sets it again
+                __atomic_fetch_and(&ready[w], ~(1ULL << b), __ATOMIC_ACQ_REL);
+                sem_post(&slot->slotFree);
+            }
+        }
+        // a doorbell post can be left over from requests an earlier scan already took
+    } while (block && received == 0);
+
+    return received;
+}
+
+/*
+* mailboxSendResponse appends a response to the train's ring. A WAIT is only informational,
+* so it is skipped while the train still has an unread response; that keeps the ring from
+* ever filling up with WAIT retries.
+*/
+bool mailboxSendResponse(const ResponseMsg& resp)
+{
+    MailboxSlot *slot = mailboxSlot(resp.mtype - 1);
+    uint32_t write = slot->responseWrite;
+    uint32_t unread = write - __atomic_load_n(&slot->responseRead, __ATOMIC_ACQUIRE);
+
+    if (resp.response_type == ResponseType::WAIT && unread > 0)
+    {
+        return true;
+    }
+    if (unread >= (uint32_t)MAILBOX_RESPONSES)
+    {
+        std::cerr << "mailboxSendResponse [ERROR]: response ring full for " << trainName(resp.mtype - 1) << std::endl;
+        return false;
+    }
+
+    slot->responses[write % MAILBOX_RESPONSES] = resp;
+    __atomic_store_n(&slot->responseWrite, write + 1, __ATOMIC_RELEASE);
+    sem_post(&slot->responsesReady);
+    return true;
+}
+
+/*
+* mailboxDepth counts requests waiting in the ready bitmap and responses the trains have not read
+* output: returns the number of trains (the capacity of the request side)
+*/
+int mailboxDepth(int &pendingRequests, int &unreadResponses)
+{
+    pendingRequests = 0;
+    unreadResponses = 0;
+    if (mailbox == nullptr)
+    {
+        return 0;
+    }
+
+    uint64_t *ready = readyBits();
+    for (int w = 0; w < mailbox->num_words; w++)
+    {
+        pendingRequests += __builtin_popcountll(__atomic_load_n(&ready[w], __ATOMIC_ACQUIRE));
+    }
+    for (int t = 0; t < mailbox->num_trains; t++)
+    {
+        MailboxSlot *slot = mailboxSlot(t);
+        unreadResponses += slot->responseWrite - __atomic_load_n(&slot->responseRead, __ATOMIC_ACQUIRE);
+    }
+    return mailbox->num_trains;
+}
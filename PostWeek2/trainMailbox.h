@@ -0,0 +1,55 @@
+/*  Group G
+    Date: 4/24/2025
+    Program Description: Per-train mailbox transport. Every train owns one request
+    slot and a small response ring in a shared mapping, plus one bit in a ready
+    bitmap the server scans with find-first-set. Nothing is allocated after setup
+    and the memory cost is constant per train, like the train rows of the held
+    and waiting matrices.
+*/
+
+#ifndef TRAIN_MAILBOX_H
+#define TRAIN_MAILBOX_H
+
+#include <cstdint>
+#include <semaphore.h>
+
+#include "TrainCommunication.h"
+
+// responses a train can have unread, GRANT/DECLINED never need more than two
+const int MAILBOX_RESPONSES = 8;
+
+// One train's mailbox, on its own cache lines so trains do not share lines
+struct alignas(64) MailboxSlot {
+    sem_t slotFree;              // 1 while the request slot may be written by the train
+    RequestMsg request;          // written by the train, read by the server
+    sem_t responsesReady;        // number of unread responses
+    uint32_t responseWrite;      // next response index the server writes
+    uint32_t responseRead;       // next response index the train reads
+    ResponseMsg responses[MAILBOX_RESPONSES];
+};
+
+struct MailboxHeader {
+    sem_t doorbell;              // posted after a ready bit is set (unless the event loop doorbell is used)
+    int num_trains;
+    int num_words;               // 64-bit words in the ready bitmap
+    size_t length;               // size of the whole mapping
+};
+
+// Create the mailboxes for num_trains trains, call before forking the trains
+bool mailboxSetup(int num_trains);
+
+// Unmap the mailboxes
+void mailboxClose();
+
+// Train side
+bool mailboxSendRequest(const RequestMsg& req);
+bool mailboxReceiveResponse(int trainIdx, ResponseMsg& resp);
+
+// Server side
+int mailboxReceiveRequests(RequestMsg* reqs, int maxRequests, bool block);
+bool mailboxSendResponse(const ResponseMsg& resp);
+
+// Queue depth for telemetry: pending request bits and unread responses, returns the train count
+int mailboxDepth(int &pendingRequests, int &unreadResponses);
+
+#endif
@@ -0,0 +1,460 @@
+/*  Group G
+    Date: 4/26/2025
+    Program Description: Unix-domain socket transport between the server and
+    externally launched train clients.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "trainSocket.h"
+#include "SimConfig.h"
+
+extern shared_mem_t *shm_ptr;
+
+// Server state
+static int listenFd = -1;
+static int pollFd = -1;
+static std::string listenPath;
+static std::vector<std::vector<int>> trainRoutes;
+static std::vector<int> trainFd;                  // client socket of each train index, -1 if not connected
+static std::vector<char> trainClaimed;            // a train can only be claimed by one client per run
+static std::unordered_map<int, int> clientTrain;  // client socket -> train index, -1 before HELLO
+static std::vector<int> disconnected;
+
+// Client state
+static int clientFd = -1;
+static std::unordered_map<int, std::string> routeNames;
+
+/* fillAddress builds a sockaddr_un for path, false if the path is too long */
+static bool fillAddress(const char *path, struct sockaddr_un& addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        std::cerr << "fillAddress [ERROR]: socket path too long: " << path << std::endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+/* sendFrame sends one frame, waiting for room if the peer's buffer is full */
+static bool sendFrame(int fd, const SocketFrame& frame)
+{
+    while (send(fd, &frame, sizeof(frame), MSG_NOSIGNAL) == -1)
+    {
+        if (errno == EAGAIN)
+        {
+            struct pollfd p = {fd, POLLOUT, 0};
+            poll(&p, 1, -1);
+        }
+        else if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+* socketServerSetup creates the listening socket and the epoll set that watches it
+* and every client. A stale socket file from an earlier run is removed first.
+*/
+bool socketServerSetup(const char *path, const std::vector<std::vector<int>>& routes)
+{
+    struct sockaddr_un addr;
+    if (!fillAddress(path, addr))
+    {
+        return false;
+    }
+    for (size_t t = 0; t < routes.size(); t++)
+    {
+        if (routes[t].size() > (size_t)SOCKET_MAX_ROUTE)
+        {
+            std::cerr << "socketServerSetup [ERROR]: route of " << trainName(t) << " is longer than " << SOCKET_MAX_ROUTE << " hops" << std::endl;
+            return false;
+        }
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd == -1)
+    {
+        std::cerr << "socketServerSetup [ERROR]: " << strerror(errno) << std::endl;
+        return false;
+    }
+    unlink(path);
+    if (bind(listenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1 || listen(listenFd, 128) == -1)
+    {
+        std::cerr << "socketServerSetup [ERROR]: Failed to listen on " << path << ": " << strerror(errno) << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    pollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    if (pollFd == -1 || epoll_ctl(pollFd, EPOLL_CTL_ADD, listenFd, &ev) == -1)
+    {
+        std::cerr << "socketServerSetup [ERROR]: Failed to set up epoll: " << strerror(errno) << std::endl;
+        if (pollFd != -1)
+        {
+            close(pollFd);
+            pollFd = -1;
+        }
+        close(listenFd);
+        listenFd = -1;
+        unlink(path);
+        return false;
+    }
+
+    listenPath = path;
+    trainRoutes = routes;
+    trainFd.assign(routes.size(), -1);
+    trainClaimed.assign(routes.size(), 0);
+    return true;
+}
+
+/* socketServerClose closes every client and removes the socket file */
+void socketServerClose()
+{
+    if (listenFd == -1)
+    {
+        return;
+    }
+    for (auto& client : clientTrain)
+    {
+        close(client.first);
+    }
+    clientTrain.clear();
+    close(pollFd);
+    close(listenFd);
+    unlink(listenPath.c_str());
+    listenFd = -1;
+    pollFd = -1;
+}
+
+int socketPollFd()
+{
+    return pollFd;
+}
+
+/* dropClient closes a client, a train that was attached to it is reported as disconnected */
+static void dropClient(int fd)
+{
+    int trainIdx = clientTrain[fd];
+    epoll_ctl(pollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clientTrain.erase(fd);
+    if (trainIdx >= 0)
+    {
+        trainFd[trainIdx] = -1;
+        disconnected.push_back(trainIdx);
+    }
+}
+
+/* welcomeClient answers a HELLO: the train index and route, then the names of the route's intersections */
+static void welcomeClient(int fd, const SocketFrame& hello)
+{
+    SocketFrame reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.kind = FrameKind::WELCOME;
+
+    char name[sizeof(hello.text)];
+    memcpy(name, hello.text, sizeof(name));
+    name[sizeof(name) - 1] = '\0';
+
+    int trainIdx = findTrainIndex(name);
+    if (trainIdx < 0 || trainClaimed[trainIdx])
+    {
+        reply.trainIdx = -1;
+        snprintf(reply.text, sizeof(reply.text), "%s", trainIdx < 0 ? "unknown train" : "train already claimed");
+        sendFrame(fd, reply);
+        std::cerr << "welcomeClient [ERROR]: refused client for " << name << ": " << reply.text << std::endl;
+        return;
+    }
+
+    trainClaimed[trainIdx] = 1;
+    trainFd[trainIdx] = fd;
+    clientTrain[fd] = trainIdx;
+
+    const std::vector<int>& route = trainRoutes[trainIdx];
+    reply.trainIdx = trainIdx;
+    reply.routeLength = route.size();
+    for (size_t hop = 0; hop < route.size(); hop++)
+    {
+        reply.route[hop] = route[hop];
+    }
+    sendFrame(fd, reply);
+
+    for (int intersectionIdx : route)
+    {
+        SocketFrame nameFrame;
+        memset(&nameFrame, 0, sizeof(nameFrame));
+        nameFrame.kind = FrameKind::NAME;
+        nameFrame.trainIdx = intersectionIdx;
+        snprintf(nameFrame.text, sizeof(nameFrame.text), "%s", intersectionName(intersectionIdx));
+        sendFrame(fd, nameFrame);
+    }
+}
+
+/*
+* socketReceiveRequests accepts new clients and reads frames from every ready client until
+* maxRequests requests are collected or nothing is left. Log frames are timestamped and written
+* together at the end, ticks advance the simulated time. With block set it waits until at least
+* one request arrives or a client disconnects.
+*/
+int socketReceiveRequests(RequestMsg* reqs, int maxRequests, bool block)
+{
+    int received = 0;
+    ServerBatch logs;
+    struct epoll_event events[16];
+
+    while (received < maxRequests)
+    {
+        bool wait = block && received == 0 && disconnected.empty() && logs.logLines.empty() && logs.events.empty();
+        int ready = epoll_wait(pollFd, events, 16, wait ? -1 : 0);
+        if (ready == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ready <= 0)
+        {
+            break;
+        }
+
+        for (int e = 0; e < ready; e++)
+        {
+            int fd = events[e].data.fd;
+            if (fd == listenFd)
+            {
+                int client;
+                while ((client = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+                {
+                    struct epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.fd = client;
+                    epoll_ctl(pollFd, EPOLL_CTL_ADD, client, &ev);
+                    clientTrain[client] = -1;
+                }
+                continue;
+            }
+
+            // read what this client has queued, leaving the rest for the next batch when reqs is full
+            SocketFrame frame;
+            while (received < maxRequests)
+            {
+                ssize_t n = recv(fd, &frame, sizeof(frame), 0);
+                if (n == -1 && (errno == EAGAIN || errno == EINTR))
+                {
+                    break;
+                }
+                if (n != (ssize_t)sizeof(frame))
+                {
+                    dropClient(fd);
+                    break;
+                }
+
+                int trainIdx = clientTrain[fd];
+                if (frame.kind == FrameKind::HELLO && trainIdx < 0)
+                {
+                    welcomeClient(fd, frame);
+                }
+                else if (trainIdx < 0)
+                {
+                    // nothing but HELLO is accepted before the train is known
+                    dropClient(fd);
+                    break;
+                }
+                else if (frame.kind == FrameKind::REQUEST)
+                {
+                    // a client can only speak for its own train
+                    reqs[received] = frame.request;
+                    reqs[received].train_id = trainIdx;
+                    received++;
+                }
+                else if (frame.kind == FrameKind::LOG)
+                {
+                    frame.text[sizeof(frame.text) - 1] = '\0';
+                    serverQueueLog(logs, frame.text, strlen(frame.text));
+                }
+                else if (frame.kind == FrameKind::TICK)
+                {
+                    __atomic_fetch_add(&shm_ptr->simulatedTime, 1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+    }
+
+    serverWriteLogs(logs);
+    return received;
+}
+
+/* socketSendResponse sends a response to the train's client, dropped if the client is gone */
+bool socketSendResponse(const ResponseMsg& resp)
+{
+    int fd = trainFd[resp.mtype - 1];
+    if (fd == -1)
+    {
+        return true;
+    }
+    SocketFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.kind = FrameKind::RESPONSE;
+    frame.response = resp;
+    if (!sendFrame(fd, frame))
+    {
+        std::cerr << "socketSendResponse [ERROR]: " << trainName(resp.mtype - 1) << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void socketTakeDisconnected(std::vector<int>& trains)
+{
+    trains.swap(disconnected);
+    disconnected.clear();
+}
+
+/*
+* socketClientConnect connects to the server, claims trainId and reads back its index,
+* its route and the names of the route's intersections
+*/
+bool socketClientConnect(const char *path, const char *trainId, int& trainIdx, std::vector<int>& routeIdx)
+{
+    struct sockaddr_un addr;
+    if (!fillAddress(path, addr))
+    {
+        return false;
+    }
+    clientFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (clientFd == -1 || connect(clientFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1)
+    {
+        std::cerr << "socketClientConnect [ERROR]: Failed to connect to " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    SocketFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.kind = FrameKind::HELLO;
+    snprintf(frame.text, sizeof(frame.text), "%s", trainId);
+    if (!sendFrame(clientFd, frame) || recv(clientFd, &frame, sizeof(frame), 0) != (ssize_t)sizeof(frame)
+        || frame.kind != FrameKind::WELCOME)
+    {
+        std::cerr << "socketClientConnect [ERROR]: No WELCOME from the server." << std::endl;
+        return false;
+    }
+    if (frame.trainIdx < 0)
+    {
+        frame.text[sizeof(frame.text) - 1] = '\0';
+        std::cerr << "socketClientConnect [ERROR]: Server refused " << trainId << ": " << frame.text << std::endl;
+        return false;
+    }
+
+    trainIdx = frame.trainIdx;
+    routeIdx.assign(frame.route, frame.route + frame.routeLength);
+    for (int hop = 0; hop < frame.routeLength; hop++)
+    {
+        SocketFrame name;
+        if (recv(clientFd, &name, sizeof(name), 0) != (ssize_t)sizeof(name) || name.kind != FrameKind::NAME)
+        {
+            std::cerr << "socketClientConnect [ERROR]: Missing intersection names from the server." << std::endl;
+            return false;
+        }
+        name.text[sizeof(name.text) - 1] = '\0';
+        routeNames[name.trainIdx] = name.text;
+    }
+    return true;
+}
+
+bool socketSendRequest(const RequestMsg& req)
+{
+    SocketFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.kind = FrameKind::REQUEST;
+    frame.request = req;
+    return sendFrame(clientFd, frame);
+}
+
+/* socketReceiveResponse blocks until the next response frame, false if the server went away */
+bool socketReceiveResponse(ResponseMsg& resp)
+{
+    SocketFrame frame;
+    while (true)
+    {
+        ssize_t n = recv(clientFd, &frame, sizeof(frame), 0);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n != (ssize_t)sizeof(frame))
+        {
+            return false;
+        }
+        if (frame.kind == FrameKind::RESPONSE)
+        {
+            resp = frame.response;
+            return true;
+        }
+    }
+}
+
+bool socketSendLog(const char *message)
+{
+    SocketFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.kind = FrameKind::LOG;
+    snprintf(frame.text, sizeof(frame.text), "%s", message);
+    return sendFrame(clientFd, frame);
+}
+
+bool socketSendTick()
+{
+    SocketFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.kind = FrameKind::TICK;
+    return sendFrame(clientFd, frame);
+}
+
+/* socketIntersectionName names an intersection of the client's route */
+const char* socketIntersectionName(int intersectionIdx)
+{
+    auto found = routeNames.find(intersectionIdx);
+    return found == routeNames.end() ? "UnknownIntersection" : found->second.c_str();
+}
+
+/*
+* runSocketClient runs one train against a --transport=socket server. The train has no shared
+* memory or message queues, only the connection, so every queue argument is -1.
+*/
+int runSocketClient(const char *trainId)
+{
+    int trainIdx;
+    std::vector<int> routeIdx;
+    if (!socketClientConnect(simConfig.socketPath, trainId, trainIdx, routeIdx))
+    {
+        return 1;
+    }
+
+    // trainName(trainIdx) is used for the train's log lines
+    trainNames.assign(trainIdx + 1, "");
+    trainNames[trainIdx] = trainId;
+
+    runTrainRoute(trainIdx, routeIdx, -1, -1, -1);
+
+    close(clientFd);
+    clientFd = -1;
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*  Group G
+    Date: 4/26/2025
+    Program Description: Unix-domain socket transport. The server listens on a
+    SOCK_SEQPACKET socket and trains connect as independent processes (started
+    with --client=TrainN, or any tool speaking the same frames), so they no longer
+    need to be forked by the server or share its memory. Every frame is one
+    SocketFrame; a train says HELLO with its name, the server answers WELCOME with
+    the train index and its route as intersection indices, then the usual
+    ACQUIRE/RELEASE/HANDOFF/DONE requests and responses follow.
+*/
+
+#ifndef TRAIN_SOCKET_H
+#define TRAIN_SOCKET_H
+
+#include <cstdint>
+#include <vector>
+
+#include "TrainCommunication.h"
+
+// longest route a WELCOME frame can carry
+const int SOCKET_MAX_ROUTE = 64;
+
+// Frame kinds
+namespace FrameKind {
+    const uint16_t HELLO = 1;      // train -> server, text: train name
+    const uint16_t WELCOME = 2;    // server -> train, trainIdx (-1 if refused) and route, text: reason when refused
+    const uint16_t NAME = 3;       // server -> train after WELCOME, trainIdx: intersection index, text: its name
+    const uint16_t REQUEST = 4;    // train -> server, request
+    const uint16_t RESPONSE = 5;   // server -> train, response
+    const uint16_t LOG = 6;        // train -> server, text: log message
+    const uint16_t TICK = 7;       // train -> server, advance simulated time by one (WAIT back-off)
+}
+
+struct SocketFrame {
+    uint16_t kind;
+    int16_t routeLength;               // WELCOME: hops in route
+    int32_t trainIdx;                  // WELCOME: train index, NAME: intersection index
+    RequestMsg request;                // REQUEST
+    ResponseMsg response;              // RESPONSE
+    int16_t route[SOCKET_MAX_ROUTE];   // WELCOME: route as intersection indices
+    char text[100];                    // HELLO, NAME, LOG and refused WELCOME
+};
+
+// Server side: listen on path, routes[t] is the route of train index t
+bool socketServerSetup(const char *path, const std::vector<std::vector<int>>& routes);
+void socketServerClose();
+
+// epoll fd that is readable when a client connects or sends a frame, -1 if not listening
+int socketPollFd();
+
+int socketReceiveRequests(RequestMsg* reqs, int maxRequests, bool block);
+bool socketSendResponse(const ResponseMsg& resp);
+
+// Trains whose client disconnected since the last call
+void socketTakeDisconnected(std::vector<int>& trains);
+
+// Train side
+bool socketClientConnect(const char *path, const char *trainId, int& trainIdx, std::vector<int>& routeIdx);
+bool socketSendRequest(const RequestMsg& req);
+bool socketReceiveResponse(ResponseMsg& resp);
+bool socketSendLog(const char *message);
+bool socketSendTick();
+const char* socketIntersectionName(int intersectionIdx);
+
+// Run one train as an external client of a --transport=socket server, returns the exit status
+int runSocketClient(const char *trainId);
+
+#endif